@@ -0,0 +1,37 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Far terrain (see horizon.h), lit by the same sun as lambert.frag.glsl
+
+uniform int u_Time;
+// (minX, minZ, maxX, maxZ) of the box the Chunks are drawn in,
+// which the far terrain leaves out
+uniform vec4 u_VoxelBounds;
+
+in vec4 fs_Pos;
+in vec4 fs_Nor;
+in vec4 fs_Col;
+
+out vec4 out_Col;
+
+const vec4 lightDir = normalize(vec4(0, 0, -1.0, 0));
+
+vec3 rotateX(vec3 p, float a) {
+    return vec3(p.x, cos(a) * p.y + -sin(a) *p.z, sin(a) * p.y +cos(a) * p.z);
+}
+
+void main()
+{
+    if (all(greaterThanEqual(fs_Pos.xz, u_VoxelBounds.xy)) &&
+        all(lessThan(fs_Pos.xz, u_VoxelBounds.zw))) {
+        discard;
+    }
+
+    //day and night light, as for the Chunks
+    vec3 sunDir = rotateX(lightDir.xyz, u_Time * 0.05);
+    vec3 diffuseLight = vec3(dot(normalize(fs_Nor), vec4(normalize(sunDir), 0.0)));
+    diffuseLight = clamp(diffuseLight, 0, 1) * vec3(255, 255, 190) / 255.0;
+    vec3 ambientLight = vec3(0.5) * vec3(144, 96, 144) /255.0;
+
+    out_Col = vec4(diffuseLight + ambientLight, 1) * fs_Col;
+}
@@ -0,0 +1,25 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Far terrain (see horizon.h). Refer to the lambert shader files for
+// useful comments.
+
+uniform mat4 u_ViewProj;
+
+in vec4 vs_Pos;
+in vec4 vs_Nor;
+in vec4 vs_Col;
+
+out vec4 fs_Pos;
+out vec4 fs_Nor;
+out vec4 fs_Col;
+
+void main()
+{
+    fs_Pos = vs_Pos;
+    fs_Nor = vs_Nor;
+    fs_Col = vs_Col;
+
+    // The heightfield is already in world space
+    gl_Position = u_ViewProj * vs_Pos;
+}
@@ -22,7 +22,8 @@ in vec4 fs_Pos;
 in vec4 fs_Nor;
 in vec4 fs_LightVec;
 //in vec4 fs_Col;
-in vec2 fs_UV;
+flat in vec2 fs_UV;
+in vec2 fs_BlockUV;
 in float fs_animate;
 
 
@@ -86,12 +87,12 @@ void main()
 {
 
     //if water or lava, it animates by changing uv slightly
-    vec2 uv = fs_UV;
+    vec2 uv = fs_UV + fract(fs_BlockUV) / 16.f;
         if (fs_animate != 0.0f) {
             if (fs_Nor[0] != 0.0f || fs_Nor[2] != 0.0f) {
-                uv = vec2(fs_UV.x + mod(u_Time / 8000.f, 1.f / 16.f), fs_UV.y);
+                uv = vec2(uv.x + mod(u_Time / 8000.f, 1.f / 16.f), uv.y);
             } else {
-                uv = vec2(fs_UV.x + mod(u_Time / 8000.f, 1.f / 16.f), fs_UV.y);
+                uv = vec2(uv.x + mod(u_Time / 8000.f, 1.f / 16.f), uv.y);
             }
         }
 
@@ -22,43 +22,65 @@ uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformati
 
 uniform vec4 u_Color;       // When drawing the cube instance, we'll set our uniform color to represent different block types.
 
-in vec4 vs_Pos;             // The array of vertex positions passed to the shader
+uniform vec3 u_ChunkOrigin; // World position the chunk's vertex positions are relative to
 
-in vec4 vs_Nor;             // The array of vertex normals passed to the shader
-
-//in vec4 vs_Col;             // The array of vertex colors passed to the shader.
-
-in vec2 vs_UV;
-
-in float vs_animate;
+in uvec2 vs_Packed;         // One packed ChunkVertex (see chunk.h):
+                            // x = local x (5 bits) | y (9 bits) << 5 | z (5 bits) << 14 | face (3 bits) << 19
+                            // y = atlas tile (8 bits) | quad corner (2 bits) << 8 | anim (1 bit) << 10
 
 out vec4 fs_Pos;
 out vec4 fs_Nor;            // The array of normals that has been transformed by u_ModelInvTr. This is implicitly passed to the fragment shader.
 out vec4 fs_LightVec;       // The direction in which our virtual light lies, relative to each vertex. This is implicitly passed to the fragment shader.
 //out vec4 fs_Col;            // The color of each vertex. This is implicitly passed to the fragment shader.
 
-out vec2 fs_UV;
+flat out vec2 fs_UV;        // Lower-left corner of the block's texture atlas tile
+out vec2 fs_BlockUV;        // Position on the face in block units; its fractional part
+                            // picks the texel inside the tile, so a quad spanning
+                            // several blocks repeats the tile once per block.
 out float fs_animate;
 
 const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));  // The direction of our virtual light, which is used to compute the shading of
                                         // the geometry in the fragment shader.
 
+// Normals of the six faces, in the order of the Direction enum
+const vec3 faceNormals[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0),
+                                   vec3(0, 1, 0), vec3(0, -1, 0),
+                                   vec3(0, 0, 1), vec3(0, 0, -1));
+
+// Project the vertex position onto the plane of its face, oriented so that
+// each face keeps the texture orientation it had when quads were one block wide
+vec2 faceUV(vec3 p, vec3 n)
+{
+    if (abs(n.y) > 0.5) {
+        return vec2(p.x, -n.y * p.z);
+    } else if (abs(n.x) > 0.5) {
+        return vec2(-n.x * p.z, p.y);
+    }
+    return vec2(n.z * p.x, p.y);
+}
+
 void main()
 {
-    fs_Pos = vs_Pos;
+    vec3 localPos = vec3(vs_Packed.x & 31u, (vs_Packed.x >> 5) & 511u, (vs_Packed.x >> 14) & 31u);
+    vec4 worldPos = vec4(u_ChunkOrigin + localPos, 1);
+    vec4 normal = vec4(faceNormals[int((vs_Packed.x >> 19) & 7u)], 0);
+    uint tile = vs_Packed.y & 255u;
+
+    fs_Pos = worldPos;
     //fs_Col = vs_Col;                         // Pass the vertex colors to the fragment shader for interpolation
-    fs_UV = vs_UV;
-    fs_animate = vs_animate;
+    fs_UV = vec2(tile & 15u, tile >> 4) / 16.f;
+    fs_BlockUV = faceUV(worldPos.xyz, normal.xyz);
+    fs_animate = float((vs_Packed.y >> 10) & 1u);
 
     mat3 invTranspose = mat3(u_ModelInvTr);
-    fs_Nor = vec4(invTranspose * vec3(vs_Nor), 0);          // Pass the vertex normals to the fragment shader for interpolation.
+    fs_Nor = vec4(invTranspose * vec3(normal), 0);          // Pass the vertex normals to the fragment shader for interpolation.
                                                             // Transform the geometry's normals by the inverse transpose of the
                                                             // model matrix. This is necessary to ensure the normals remain
                                                             // perpendicular to the surface after the surface is transformed by
                                                             // the model matrix.
 
 
-    vec4 modelposition = u_Model * vs_Pos;   // Temporarily store the transformed vertex positions for use below
+    vec4 modelposition = u_Model * worldPos;   // Temporarily store the transformed vertex positions for use below
 
     fs_LightVec = (lightDir);  // Compute the direction in which the light source lies
 
@@ -51,6 +51,15 @@ address_sanitizer {
     QMAKE_LFLAGS += -fsanitize=address
 }
 
+# ThreadSanitizer instead, e.g. `qmake CONFIG+=thread_sanitizer`, to check
+# the worker threads for data races; tests/tests.pro takes the same option
+# for its stress tests. Cannot be combined with ASAN.
+thread_sanitizer {
+    message("Enabling Thread Sanitizer")
+    QMAKE_CXXFLAGS += -fsanitize=thread
+    QMAKE_LFLAGS += -fsanitize=thread
+}
+
 HEADERS +=
 
 SOURCES +=
@@ -1,52 +1,46 @@
 #include "blocktypeworker.h"
 #include "iostream"
+#include "scene/zonegenerator.h"
 
 BlockTypeWorker::BlockTypeWorker(Terrain * terrain,
                                  int64_t hashCoord,
                                  std::vector<Chunk*> terrainsChunk,
-                                 std::vector<Chunk *> *mp_chunksWithOnlyBlockData,
-                                 QMutex* mutex)
-    :mp_terrain(terrain), coord(hashCoord), terrainsChunk(terrainsChunk), mp_chunksWithOnlyBlockData(mp_chunksWithOnlyBlockData), mp_mutex(mutex)
+                                 CompletionQueue<Chunk*> *mp_chunksWithOnlyBlockData,
+                                 sPtr<const ZoneHeightfield> heightfield)
+    :mp_terrain(terrain), coord(hashCoord), terrainsChunk(terrainsChunk), mp_chunksWithOnlyBlockData(mp_chunksWithOnlyBlockData),
+      mp_heightfield(std::move(heightfield)),
+      m_epoch(terrain->beginWork())
 {
 }
 
 void BlockTypeWorker::run() {
     // create 4 by 4 chunks and set its neighbors
     createChunksInTerrain();
+    mp_terrain->endWork(m_epoch);
 }
 
 void BlockTypeWorker::createChunksInTerrain() {
-     int x = toCoords(coord).x;
-     int z = toCoords(coord).y;
-
-     // fill chunk with block
-     for (int i = x; i < x + 64; i++) {
-         for (int j = z; j < z + 64; j++) {
-             try {
-             mp_terrain->fillBlock(i, j);
-             }
-             catch(std::out_of_range &e) {
-                 std::cout << "out of range in blocktypeworker";
-             }
-         }
-     }
-     River river = River(mp_terrain, x, z);
-     Cave cave = Cave(mp_terrain, x, z);
-     double random = ((double) rand() / (RAND_MAX));
-     if (random < 0.15)
-        river.draw();
-     double random2 = ((double) rand() / (RAND_MAX));
-     if (random2 < 0.15)
-     {
-        cave.carveOpening();
+     for (Chunk *c : terrainsChunk) {
+         c->beginGenerating();
      }
 
-    mp_mutex->lock();
-
+     // The stages of ZoneGenerator; the heightfield is only made here if no
+     // heightfield job made it earlier, and then handed to the Terrain to keep
+     ZoneGenerator generator(mp_terrain, coord);
+     if (mp_heightfield == nullptr) {
+         sPtr<ZoneHeightfield> heightfield = mkS<ZoneHeightfield>();
+         generator.generateBiomeFields();
+         generator.generateHeightFields(heightfield.get());
+         mp_terrain->zonesWithHeightfields.push({coord, heightfield});
+         mp_heightfield = heightfield;
+     }
+     generator.fillColumns(*mp_heightfield);
+     generator.addFeatures();
+     // Player edits made before the zone was last unloaded
+     mp_terrain->restoreSavedChunks(terrainsChunk);
 
     for (Chunk *c : terrainsChunk) {
-         mp_terrain->chunksWithOnlyBlockData.push_back(c);
+         c->markBlocksReady();
+         mp_chunksWithOnlyBlockData->push(c);
     }
-
-    mp_mutex->unlock();
 }
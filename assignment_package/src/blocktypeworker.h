@@ -1,6 +1,5 @@
 #pragma once
 #include <QRunnable>
-#include <QMutex>
 #include <scene/terrain.h>
 using namespace std;
 
@@ -10,16 +9,19 @@ private:
    Terrain *mp_terrain;
    int64_t coord;
    std::vector<Chunk*> terrainsChunk;
-   std::vector<Chunk*> *mp_chunksWithOnlyBlockData;
-   QMutex *mp_mutex;
+   CompletionQueue<Chunk*> *mp_chunksWithOnlyBlockData;
+   // The zone's heightfield, or nullptr to make it here
+   sPtr<const ZoneHeightfield> mp_heightfield;
+   // Terrain::beginWork's epoch, released when run() is done
+   uint64_t m_epoch;
 
 public:
 //    BlockTypeWorker();
     BlockTypeWorker(Terrain * terrain,
                     int64_t hashCoord,
                     std::vector<Chunk*> terrainsChunk,
-                    std::vector<Chunk*> *mp_chunksWithOnlyBlockData,
-                    QMutex* mutex);
+                    CompletionQueue<Chunk*> *mp_chunksWithOnlyBlockData,
+                    sPtr<const ZoneHeightfield> heightfield = nullptr);
     void run() override;
 
     // create 4 by 4 chunks and set its neighbors
@@ -0,0 +1,49 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Hands results from worker threads to the main thread without a lock.
+// Any thread may push; only one thread takes. push links a node onto an
+// atomic list head and takeAll swaps the whole list out at once, so the
+// two sides never wait for each other.
+template <class T>
+class CompletionQueue
+{
+public:
+    CompletionQueue() : m_head(nullptr) {}
+    ~CompletionQueue() {
+        takeAll();
+    }
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    void push(T value) {
+        Node *node = new Node {std::move(value), m_head.load(std::memory_order_relaxed)};
+        while (!m_head.compare_exchange_weak(node->next, node,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {}
+    }
+
+    // Everything pushed so far, oldest first
+    std::vector<T> takeAll() {
+        Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+        std::vector<T> values;
+        while (node != nullptr) {
+            values.push_back(std::move(node->value));
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+        std::reverse(values.begin(), values.end());
+        return values;
+    }
+
+private:
+    struct Node {
+        T value;
+        Node *next;
+    };
+
+    std::atomic<Node*> m_head;
+};
@@ -0,0 +1,15 @@
+#include "heightfieldworker.h"
+#include "scene/zonegenerator.h"
+
+HeightfieldWorker::HeightfieldWorker(Terrain *terrain, int64_t zone,
+                                     CompletionQueue<std::pair<int64_t, sPtr<const ZoneHeightfield>>> *zonesWithHeightfields)
+    : mp_terrain(terrain), m_zone(zone), mp_zonesWithHeightfields(zonesWithHeightfields)
+{}
+
+void HeightfieldWorker::run() {
+    sPtr<ZoneHeightfield> heightfield = mkS<ZoneHeightfield>();
+    ZoneGenerator generator(mp_terrain, m_zone);
+    generator.generateBiomeFields();
+    generator.generateHeightFields(heightfield.get());
+    mp_zonesWithHeightfields->push({m_zone, heightfield});
+}
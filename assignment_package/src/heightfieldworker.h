@@ -0,0 +1,17 @@
+#pragma once
+#include <QRunnable>
+#include <scene/terrain.h>
+
+class HeightfieldWorker : public QRunnable
+{
+private:
+    Terrain *mp_terrain;
+    int64_t m_zone;
+    CompletionQueue<std::pair<int64_t, sPtr<const ZoneHeightfield>>> *mp_zonesWithHeightfields;
+
+public:
+    HeightfieldWorker(Terrain *terrain, int64_t zone,
+                      CompletionQueue<std::pair<int64_t, sPtr<const ZoneHeightfield>>> *zonesWithHeightfields);
+    // Runs the zone's first two ZoneGenerator stages; reads no Chunk
+    void run() override;
+};
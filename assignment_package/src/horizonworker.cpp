@@ -0,0 +1,10 @@
+#include "horizonworker.h"
+
+HorizonWorker::HorizonWorker(Terrain *terrain, int64_t key, int level,
+                             CompletionQueue<HorizonTileData> *sampledTiles)
+    : mp_terrain(terrain), m_key(key), m_level(level), mp_sampledTiles(sampledTiles)
+{}
+
+void HorizonWorker::run() {
+    mp_sampledTiles->push(Horizon::sampleTile(mp_terrain, m_key, m_level));
+}
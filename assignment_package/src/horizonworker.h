@@ -0,0 +1,18 @@
+#pragma once
+#include <QRunnable>
+#include <scene/horizon.h>
+
+class HorizonWorker : public QRunnable
+{
+private:
+    Terrain *mp_terrain;
+    int64_t m_key;
+    int m_level;
+    CompletionQueue<HorizonTileData> *mp_sampledTiles;
+
+public:
+    HorizonWorker(Terrain *terrain, int64_t key, int level,
+                  CompletionQueue<HorizonTileData> *sampledTiles);
+    // Samples the tile; only reads the height functions, never a Chunk
+    void run() override;
+};
@@ -0,0 +1,39 @@
+#include "meshbufferpool.h"
+
+// Upper bounds on how many idle buffers are kept around
+static const size_t maxCachedPerThread = 8;
+static const size_t maxReleased = 64;
+
+QMutex MeshBufferPool::s_mutex;
+std::vector<std::vector<ChunkVertex>> MeshBufferPool::s_released;
+
+std::vector<ChunkVertex> MeshBufferPool::acquire(size_t minVertices) {
+    thread_local std::vector<std::vector<ChunkVertex>> cache;
+
+    if (cache.empty()) {
+        s_mutex.lock();
+        while (!s_released.empty() && cache.size() < maxCachedPerThread) {
+            cache.push_back(std::move(s_released.back()));
+            s_released.pop_back();
+        }
+        s_mutex.unlock();
+    }
+
+    std::vector<ChunkVertex> buffer;
+    if (!cache.empty()) {
+        buffer = std::move(cache.back());
+        cache.pop_back();
+    }
+    buffer.reserve(minVertices);
+    return buffer;
+}
+
+void MeshBufferPool::release(std::vector<ChunkVertex> &&buffer) {
+    // clear() keeps the capacity, which is what makes the buffer worth reusing
+    buffer.clear();
+    s_mutex.lock();
+    if (s_released.size() < maxReleased) {
+        s_released.push_back(std::move(buffer));
+    }
+    s_mutex.unlock();
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <QMutex>
+#include <vector>
+#include <scene/chunk.h>
+
+// Recycles the vertex buffers VBOWorkers mesh Chunks into, so that meshing
+// does not allocate (and grow) fresh vectors for every Chunk.
+// Each worker thread keeps a small cache of empty buffers; buffers whose
+// contents have been uploaded are handed back by the GL thread to a shared
+// list that the worker caches refill from when they run dry.
+class MeshBufferPool
+{
+public:
+    // Returns an empty buffer with room for at least minVertices vertices
+    static std::vector<ChunkVertex> acquire(size_t minVertices);
+    // Hands back a buffer whose contents are no longer needed
+    static void release(std::vector<ChunkVertex> &&buffer);
+
+private:
+    static QMutex s_mutex;
+    static std::vector<std::vector<ChunkVertex>> s_released;
+};
@@ -3,9 +3,13 @@
 #include <iostream>
 #include <QApplication>
 #include <QKeyEvent>
+#include <QDebug>
 #include <qdatetime.h>
+#include <QElapsedTimer>
 #include "src/blocktypeworker.h"
 #include "src/vboworker.h"
+#include "src/heightfieldworker.h"
+#include "src/scene/zonegenerator.h"
 #include <QThreadPool>
 #include <thread>
 
@@ -14,10 +18,11 @@ MyGL::MyGL(QWidget *parent)
     : OpenGLContext(parent),
       m_worldAxes(this),
       m_progLambert(this), m_progFlat(this),
-      m_terrain(this), m_player(glm::vec3(48.f, 160.f, 48.f), m_terrain),
+      m_terrain(this), m_horizon(this, &m_terrain), m_progHorizon(this),
+      m_player(glm::vec3(48.f, 160.f, 48.f), m_terrain),
       m_currMSecSinceEpoch(QDateTime::currentMSecsSinceEpoch()),
      mp_progSky(this), mp_geomQuad(this),
-     isChunksCreated(false),
+     isChunksCreated(false), m_avgFrameTime(0.f),
      m_texture(this),  m_time(0.f), mp_NPC(new NPC(m_terrain, this))
 {
     // Connect the timer to a function so that when the timer ticks the function is executed
@@ -76,6 +81,7 @@ void MyGL::initializeGL()
 
 
     mp_progSky.create(":/glsl/sky.vert.glsl", ":/glsl/sky.frag.glsl");
+    m_progHorizon.create(":/glsl/horizon.vert.glsl", ":/glsl/horizon.frag.glsl");
     mp_geomQuad.create();
 
     // Set a color with which to draw geometry.
@@ -133,6 +139,9 @@ void MyGL::tick() {
     // For every terrain generation zone in this radius that does not yet exist in Terrain's m_generatedTerrain,
     // spawn a thread to fill that zone's Chunks with procedural height field BlockType data.
     // Check if new Terrain Zene Chunks need to be crasted an populated
+    m_terrain.recenter(m_player.getPosition());
+    // Far Chunks are meshed coarser, so the view reaches further
+    m_terrain.updateLevelsOfDetail(m_player.getPosition());
     std::vector<int64_t> terrainNotExpanded = m_terrain.checkExpansion(m_player.getPosition());
 
     // expected :: 24
@@ -152,28 +161,34 @@ void MyGL::tick() {
     }
 
     for (unsigned int i = 0; i < terrainNotExpanded.size(); i++) {
-        BlockTypeWorker *bWorker = new BlockTypeWorker(&m_terrain, terrainNotExpanded.at(i), terrainsChunk[i], &m_terrain.chunksWithOnlyBlockData, &m_terrain.mutexWithOnlyBlockData);
+        BlockTypeWorker *bWorker = new BlockTypeWorker(&m_terrain, terrainNotExpanded.at(i), terrainsChunk[i], &m_terrain.chunksWithOnlyBlockData,
+                                                       m_terrain.heightfieldOf(terrainNotExpanded.at(i)));
         QThreadPool::globalInstance()->start(bWorker);
     }
 
-    m_terrain.mutexWithOnlyBlockData.lock();
-    for (Chunk *c : m_terrain.chunksWithOnlyBlockData) {
+    // Zones past the voxel radius only get their heightfield, which the
+    // zone's Chunks are filled from once the player comes close
+    m_terrain.updateHeightfields(m_player.getPosition());
+    for (int64_t zone : m_terrain.checkHeightfieldExpansion(m_player.getPosition())) {
+        QThreadPool::globalInstance()->start(new HeightfieldWorker(&m_terrain, zone, &m_terrain.zonesWithHeightfields));
+    }
+
+    // Chunks are only meshed once their neighbors' blocks are ready as well
+    for (Chunk *c : m_terrain.scheduleMeshing(m_terrain.chunksWithOnlyBlockData.takeAll())) {
         VBOWorker *vboWorker = new VBOWorker(&m_terrain,
                                              &m_terrain.chunksWithVBOData,
-                                             c,
-                                             &m_terrain.mutexChunksWithVBOData);
+                                             c);
         QThreadPool::globalInstance()->start(vboWorker);
     }
-    m_terrain.chunksWithOnlyBlockData.clear();
-    m_terrain.mutexWithOnlyBlockData.unlock();
 
-    m_terrain.mutexChunksWithVBOData.lock();
-    for (ChunkVBOData c: m_terrain.chunksWithVBOData) {
-        c.associated_chunk->sendToGPU(&c.vertex_opq_data, &c.idx_opq_data,
-                                      &c.vertex_tran_data, &c.idx_tran_data);
-    }
-    m_terrain.chunksWithVBOData.clear();
-    m_terrain.mutexChunksWithVBOData.unlock();
+    // Edited Chunks keep drawing their old mesh until the new one is swapped in here
+    m_terrain.uploadMeshes();
+
+    // Far zones are unloaded once the Terrain outgrows its memory budget
+    m_terrain.unloadChunks(m_player.getPosition());
+
+    // Beyond the Chunks, the terrain is drawn as a coarse heightfield
+    m_horizon.update(m_player.getPosition());
 
     isChunksCreated = true;
 
@@ -197,6 +212,8 @@ void MyGL::sendPlayerDataToGUI() const {
 // MyGL's constructor links update() to a timer that fires 60 times per second,
 // so paintGL() called at a rate of 60 frames per second.
 void MyGL::paintGL() {
+    QElapsedTimer frameTimer;
+    frameTimer.start();
     // Clear the screen so that we only see newly drawn images
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -216,6 +233,11 @@ void MyGL::paintGL() {
     this->glUniform1f(mp_progSky.unifTime, m_time);
     mp_progSky.draw(mp_geomQuad);
 
+    // The far terrain has its own depth range, so the Chunks are drawn
+    // over it with a fresh depth buffer
+    renderHorizon();
+    glClear(GL_DEPTH_BUFFER_BIT);
+
     renderTerrain();
 
     mp_NPC->destroy();
@@ -224,6 +246,7 @@ void MyGL::paintGL() {
     m_progFlat.setModelMatrix(glm::mat4());
     m_progFlat.setViewProjMatrix(m_player.mcr_camera.getViewProj());
     glEnable(GL_DEPTH_TEST);
+    m_avgFrameTime = glm::mix(m_avgFrameTime, frameTimer.nsecsElapsed() / 1e9f, 0.05f);
 }
 
 // TODO: Change this so it renders the nine zones of generated
@@ -232,16 +255,50 @@ void MyGL::paintGL() {
 void MyGL::renderTerrain() {
 
     int currX = glm::floor(m_player.mcr_position.x / 64.f) * 64;
-    int minX = currX - 128;
-    int maxX = currX + 128;
+    int minX = currX - Terrain::DRAW_DISTANCE;
+    int maxX = currX + Terrain::DRAW_DISTANCE;
     int currZ = glm::floor(m_player.mcr_position.z / 64.f) * 64;
-    int minZ = currZ - 128;
-    int maxZ = currZ + 128;
+    int minZ = currZ - Terrain::DRAW_DISTANCE;
+    int maxZ = currZ + Terrain::DRAW_DISTANCE;
     //depending on the player's position, render terrain including a new chunk
 
    m_terrain.draw(minX, maxX, minZ, maxZ, &m_progLambert);
 }
 
+void MyGL::renderHorizon() {
+    int currX = glm::floor(m_player.mcr_position.x / 64.f) * 64;
+    int currZ = glm::floor(m_player.mcr_position.z / 64.f) * 64;
+    m_progHorizon.setViewProjMatrix(m_player.mcr_camera.getViewProj(Horizon::NEAR_CLIP, Horizon::FAR_CLIP));
+    m_progHorizon.setVoxelBounds(currX - Terrain::DRAW_DISTANCE, currX + Terrain::DRAW_DISTANCE,
+                                 currZ - Terrain::DRAW_DISTANCE, currZ + Terrain::DRAW_DISTANCE);
+    this->glUniform1i(m_progHorizon.unifTime, m_time);
+
+    m_horizon.draw(&m_progHorizon);
+}
+
+void MyGL::toggleGreedyMeshing() {
+    int currX = glm::floor(m_player.mcr_position.x / 64.f) * 64;
+    int currZ = glm::floor(m_player.mcr_position.z / 64.f) * 64;
+    long long vertices = m_terrain.vertexCount(currX - Terrain::DRAW_DISTANCE, currX + Terrain::DRAW_DISTANCE,
+                                               currZ - Terrain::DRAW_DISTANCE, currZ + Terrain::DRAW_DISTANCE);
+    qInfo() << (Chunk::greedyMeshing() ? "greedy" : "per-face") << "mesher:"
+            << vertices << "vertices in view,"
+            << m_avgFrameTime * 1000.f << "ms per paintGL";
+
+    Chunk::setGreedyMeshing(!Chunk::greedyMeshing());
+    m_terrain.remeshAll();
+    qInfo() << "switched to" << (Chunk::greedyMeshing() ? "greedy" : "per-face") << "mesher";
+}
+
+void MyGL::printZoneGenerationTimes() const {
+    std::array<double, ZoneGenerator::STAGE_COUNT> times = ZoneGenerator::averageStageTimes();
+    QDebug info = qInfo();
+    info << "zone generation, ms per zone:";
+    for (int stage = 0; stage < ZoneGenerator::STAGE_COUNT; ++stage) {
+        info << ZoneGenerator::stageName(ZoneGenerator::Stage(stage)) << times[stage];
+    }
+}
+
 // construct an inputbundle in keypress event with appropriate info
 // and read the info to update the velocity and position
 void MyGL::keyPressEvent(QKeyEvent *e) {
@@ -249,6 +306,12 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
     if (e->key() == Qt::Key_Escape) {
         QApplication::quit();
     }
+    if (e->key() == Qt::Key_G && !e->isAutoRepeat()) {
+        toggleGreedyMeshing();
+    }
+    if (e->key() == Qt::Key_T && !e->isAutoRepeat()) {
+        printZoneGenerationTimes();
+    }
     if (!e->isAutoRepeat()) {
         keyPressUpdate(e);
     }
@@ -272,6 +335,7 @@ void MyGL::mouseMoveEvent(QMouseEvent *e) {
 }
 
 void MyGL::mousePressEvent(QMouseEvent *e) {
+    // Edited Chunks are meshed again on workers and uploaded in tick()
     if (e->button() == Qt::LeftButton) {
         m_player.destroyBlock(&m_terrain);
     } else if (e->button() == Qt::RightButton) {
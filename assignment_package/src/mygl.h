@@ -6,6 +6,7 @@
 #include "scene/worldaxes.h"
 #include "scene/camera.h"
 #include "scene/terrain.h"
+#include "scene/horizon.h"
 #include "scene/player.h"
 #include "texture.h"
 #include "scene/quad.h"
@@ -28,6 +29,8 @@ private:
                 // Don't worry too much about this. Just know it is necessary in order to render geometry.
 
     Terrain m_terrain; // All of the Chunks that currently comprise the world.
+    Horizon m_horizon; // Heightfield of the terrain past the Chunks
+    ShaderProgram m_progHorizon; // A shader program for the far terrain
     Player m_player; // The entity controlled by the user. Contains a camera to display what it sees as well.
     InputBundle m_inputs; // A collection of variables to be updated in keyPressEvent, mouseMoveEvent, mousePressEvent, etc.
 
@@ -53,6 +56,17 @@ private:
 
     bool isChunksCreated;
 
+    // Running average of the time paintGL takes, in seconds. GL calls
+    // return before the GPU has run them, so this is the CPU side of a frame.
+    float m_avgFrameTime;
+
+    // Prints the vertex count of the rendered Chunks and the average
+    // paintGL time, then switches Chunk meshing between per-face and greedy
+    void toggleGreedyMeshing();
+    // Prints the average time a terrain generation zone spent in each
+    // ZoneGenerator stage so far
+    void printZoneGenerationTimes() const;
+
     NPC *mp_NPC;
 
 public:
@@ -73,6 +87,9 @@ public:
     // Called from paintGL().
     // Calls Terrain::draw().
     void renderTerrain();
+    // Called from paintGL() before renderTerrain().
+    // Draws the far terrain around the box the Chunks are drawn in.
+    void renderHorizon();
 
     // key updates
     void keyPressUpdate(QKeyEvent *e);
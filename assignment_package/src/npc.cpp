@@ -1,4 +1,6 @@
 #include "npc.h"
+#include "scene/blockregistry.h"
+#include "scene/blockcursor.h"
 
 NPC::NPC(const Terrain &terrain, OpenGLContext *context)
     : Drawable(context), mcr_terrain(terrain), ifAxis(-1), isOnGround(false), isCollision(false)
@@ -83,6 +85,7 @@ bool NPC::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &
     glm::ivec3 currCell = glm::ivec3(glm::floor(rayOrigin));
     rayDirection = glm::normalize(rayDirection); // now all t values represent world dist
 
+    ConstBlockCursor cursor(terrain);
     float curr_t = 0.f;
     while (curr_t < maxLen) {
         float min_t = glm::sqrt(3.f);
@@ -114,10 +117,11 @@ bool NPC::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &
         glm::ivec3 offset = glm::ivec3(0, 0, 0);
         offset[interfaceAxis] = glm::min(0.f, glm::sign(rayDirection[interfaceAxis]));
         currCell = glm::ivec3(glm::floor(rayOrigin)) + offset;
-        // If the currCell contains something other than empty, return curr_t
-        BlockType cellType = terrain.getBlockAt(currCell.x, currCell.y, currCell.z);
+        // If the currCell contains something other than empty, return curr_t.
+        // Chunks that are not loaded yet have nothing to collide with.
+        BlockType cellType = cursor.get(currCell.x, currCell.y, currCell.z).value_or(EMPTY);
 
-        if (cellType != EMPTY) {
+        if (BlockRegistry::isCollidable(cellType)) {
             *out_blockHit = currCell;
             *out_dist = glm::min(maxLen, curr_t);
             isCollision = true;
@@ -133,11 +137,12 @@ bool NPC::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &
 bool NPC::isOnGroundLevel(const Terrain &terrain) {
 
     glm::vec3 bottomLeftVertex = this->m_position - glm::vec3(0.5f, 0.f, 0.5f);
+    ConstBlockCursor cursor(terrain);
     for (int x = 0; x <= 1; x++) {
         for (int z = 0; z <= 1; z++) {
-            if (terrain.getBlockAt(floor(bottomLeftVertex[0]) + x,
-                                   floor(bottomLeftVertex[1] - 0.005f),
-                                   floor(bottomLeftVertex[2]) + z) != EMPTY) {
+            if (BlockRegistry::isCollidable(cursor.get(floor(bottomLeftVertex[0]) + x,
+                                                       floor(bottomLeftVertex[1] - 0.005f),
+                                                       floor(bottomLeftVertex[2]) + z).value_or(EMPTY))) {
 
                 isOnGround = true;
                 m_velocity.y = 0.f;
@@ -151,6 +156,10 @@ bool NPC::isOnGroundLevel(const Terrain &terrain) {
 
 void NPC::generatePosition() {
     m_position = glm::vec3(64.f, 140.f, 64.f);
+    // Stand on the surface if its Chunk has been generated already
+    if (mcr_terrain.hasChunkAt(64, 64)) {
+        m_position.y = mcr_terrain.getHighestBlockAt(64, 64) + 1.f;
+    }
 }
 
 void NPC::create() {
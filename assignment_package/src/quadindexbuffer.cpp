@@ -0,0 +1,63 @@
+#include "quadindexbuffer.h"
+#include <vector>
+#include <algorithm>
+
+QuadIndexBuffer::QuadIndexBuffer(OpenGLContext *context)
+    : context(context), m_bufShort(0), m_bufInt(0), m_shortQuads(0), m_intQuads(0)
+{}
+
+QuadIndexBuffer::~QuadIndexBuffer()
+{}
+
+// Regrows the buffer to at least numQuads quads, doubling its size each time
+// so that a slowly growing mesh does not trigger an upload every frame
+template <typename T>
+void QuadIndexBuffer::grow(GLuint &buffer, int &capacity, int numQuads, int maxQuads)
+{
+    if (buffer == 0) {
+        context->glGenBuffers(1, &buffer);
+    }
+    context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    if (numQuads <= capacity) {
+        return;
+    }
+
+    capacity = std::min(std::max(numQuads, std::max(2 * capacity, 1024)), maxQuads);
+    std::vector<T> indices;
+    indices.reserve(6 * capacity);
+    for (int i = 0; i < capacity; ++i) {
+        T first = static_cast<T>(4 * i);
+        indices.push_back(first);
+        indices.push_back(first + 1);
+        indices.push_back(first + 2);
+        indices.push_back(first);
+        indices.push_back(first + 2);
+        indices.push_back(first + 3);
+    }
+    context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(T), indices.data(), GL_STATIC_DRAW);
+}
+
+GLenum QuadIndexBuffer::bind(int numQuads)
+{
+    if (numQuads <= maxShortQuads) {
+        grow<GLushort>(m_bufShort, m_shortQuads, numQuads, maxShortQuads);
+        return GL_UNSIGNED_SHORT;
+    }
+    // Only meshes with more than 65536 vertices need 32-bit indices
+    // (a Chunk can never have more quads than its blocks have faces)
+    grow<GLuint>(m_bufInt, m_intQuads, numQuads, 16 * 256 * 16 * 6);
+    return GL_UNSIGNED_INT;
+}
+
+void QuadIndexBuffer::destroy()
+{
+    // Never bound, e.g. for a Terrain that was never drawn: there may not
+    // even be a GL context to call
+    if (m_bufShort == 0 && m_bufInt == 0) {
+        return;
+    }
+    context->glDeleteBuffers(1, &m_bufShort);
+    context->glDeleteBuffers(1, &m_bufInt);
+    m_bufShort = m_bufInt = 0;
+    m_shortQuads = m_intQuads = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <openglcontext.h>
+
+// Index buffer shared by every Chunk. Chunk meshes are lists of quads whose
+// four corners are stored in drawing order, so their indices are always
+// 0, 1, 2, 0, 2, 3 offset by 4 per quad. Instead of each Chunk building and
+// uploading its own copy, one buffer long enough for the largest mesh drawn
+// so far is bound for every Chunk draw.
+class QuadIndexBuffer
+{
+public:
+    QuadIndexBuffer(OpenGLContext* context);
+    ~QuadIndexBuffer();
+
+    // Binds indices for at least the given number of quads to GL_ELEMENT_ARRAY_BUFFER,
+    // growing the buffer if needed, and returns the index type to pass to glDrawElements.
+    // GL_UNSIGNED_SHORT is used whenever every vertex of the quads fits in 16 bits.
+    GLenum bind(int numQuads);
+    void destroy();
+
+    // Most quads a GL_UNSIGNED_SHORT index can address (65536 vertices)
+    static const int maxShortQuads = 16384;
+
+private:
+    template <typename T>
+    void grow(GLuint &buffer, int &capacity, int numQuads, int maxQuads);
+
+    OpenGLContext* context;
+    GLuint m_bufShort;
+    GLuint m_bufInt;
+    int m_shortQuads; // Number of quads m_bufShort currently holds indices for
+    int m_intQuads;
+};
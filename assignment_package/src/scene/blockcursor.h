@@ -0,0 +1,109 @@
+#pragma once
+#include <optional>
+#include <type_traits>
+#include "chunk.h"
+#include "terrain.h"
+
+// Reads (and, through a non-const Terrain, writes) blocks by world-space
+// coordinates. The Chunk of the last access is remembered, so a walk
+// through the world only looks a Chunk up when it crosses a Chunk border,
+// and coordinates are split into Chunk and local parts with shifts and
+// masks instead of float division.
+// Unlike Terrain::getBlockAt, an unloaded Chunk is reported, not thrown.
+// Through a const Terrain, a Chunk whose blocks are not ready yet counts as unloaded.
+// The cursor keeps the current Chunk's blocks locked (for reading through a
+// const Terrain, for writing otherwise) until it moves on, so a block access
+// takes no lock of its own. release() before reaching the same Chunk any
+// other way, e.g. through the Terrain's fills.
+template <class TerrainT>
+class BasicBlockCursor {
+private:
+    using ChunkT = typename std::conditional<std::is_const<TerrainT>::value, const Chunk, Chunk>::type;
+
+    TerrainT &mr_terrain;
+    ChunkT *mp_chunk;
+    // Lower-left corner of mp_chunk
+    int m_chunkX;
+    int m_chunkZ;
+
+public:
+    explicit BasicBlockCursor(TerrainT &terrain)
+        : mr_terrain(terrain), mp_chunk(nullptr), m_chunkX(0), m_chunkZ(0)
+    {}
+    BasicBlockCursor(const BasicBlockCursor&) = delete;
+    BasicBlockCursor& operator=(const BasicBlockCursor&) = delete;
+    ~BasicBlockCursor() {
+        release();
+    }
+
+    // Unlocks the current Chunk; the next access looks it up again
+    void release() {
+        if (mp_chunk != nullptr) {
+            mp_chunk->unlockBlocks();
+            mp_chunk = nullptr;
+        }
+    }
+
+    // Moves the cursor to the Chunk containing (x, z) and returns it,
+    // or nullptr if that Chunk is not loaded
+    ChunkT* chunkAt(int x, int z) {
+        int chunkX = x & ~15;
+        int chunkZ = z & ~15;
+        if (mp_chunk == nullptr || chunkX != m_chunkX || chunkZ != m_chunkZ) {
+            release();
+            ChunkT *c = mr_terrain.findChunkAt(chunkX, chunkZ);
+            if constexpr (std::is_const<TerrainT>::value) {
+                // Readers of a const Terrain (physics, NPCs) do not see
+                // Chunks that are still being generated
+                if (c != nullptr && c->blocksReady()) {
+                    c->lockBlocksForReading();
+                    mp_chunk = c;
+                }
+            } else if (c != nullptr) {
+                c->lockBlocksForWriting();
+                mp_chunk = c;
+            }
+            m_chunkX = chunkX;
+            m_chunkZ = chunkZ;
+        }
+        return mp_chunk;
+    }
+
+    // The block at these world-space coordinates, or std::nullopt if its
+    // Chunk is not loaded. Like Terrain::getBlockAt, y outside [0, 256)
+    // reads as EMPTY.
+    std::optional<BlockType> get(int x, int y, int z) {
+        ChunkT *c = chunkAt(x, z);
+        if (c == nullptr) {
+            return std::nullopt;
+        }
+        if (y < 0 || y >= 256) {
+            return EMPTY;
+        }
+        return c->getBlockUnchecked(x & 15, y, z & 15);
+    }
+
+    // The block at these coordinates, which must lie in a loaded Chunk with y in [0, 256)
+    BlockType getUnchecked(int x, int y, int z) {
+        return chunkAt(x, z)->getBlockUnchecked(x & 15, y, z & 15);
+    }
+
+    // Writes the block if its Chunk is loaded and y is in [0, 256).
+    // Returns whether it was written.
+    bool set(int x, int y, int z, BlockType t) {
+        ChunkT *c = chunkAt(x, z);
+        if (c == nullptr || y < 0 || y >= 256) {
+            return false;
+        }
+        c->setBlockUnchecked(x & 15, y, z & 15, t);
+        return true;
+    }
+
+    // Writes a block at coordinates that must lie in a loaded Chunk with y in [0, 256)
+    void setUnchecked(int x, int y, int z, BlockType t) {
+        chunkAt(x, z)->setBlockUnchecked(x & 15, y, z & 15, t);
+    }
+};
+
+using BlockCursor = BasicBlockCursor<Terrain>;
+using ConstBlockCursor = BasicBlockCursor<const Terrain>;
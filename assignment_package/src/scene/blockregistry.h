@@ -0,0 +1,53 @@
+#pragma once
+#include "chunk.h"
+#include <array>
+
+// Properties a BlockType can have, stored as one bitset per type.
+// (Prefixed with BLOCK_ because OPAQUE and TRANSPARENT are macros in the Windows headers.)
+enum BlockProperty : unsigned char {
+    BLOCK_SOLID       = 1 << 0, // A full cube of matter rather than air or liquid
+    BLOCK_OPAQUE      = 1 << 1, // Drawn in the opaque pass, hides the faces of the blocks touching it
+    BLOCK_TRANSPARENT = 1 << 2, // Drawn in the transparent pass, the faces behind it stay visible
+    BLOCK_ANIMATED    = 1 << 3, // Scrolls its texture in lambert.frag.glsl
+    BLOCK_FLUID       = 1 << 4, // A liquid
+    BLOCK_COLLIDABLE  = 1 << 5  // Stops the player and NPCs, and is what their grid marches hit
+};
+
+// The properties of every possible BlockType value.
+// Types without an entry below behave like stone.
+constexpr std::array<unsigned char, 256> makeBlockProperties() {
+    std::array<unsigned char, 256> properties {};
+    for (int t = 0; t < 256; ++t) {
+        properties[t] = BLOCK_SOLID | BLOCK_OPAQUE | BLOCK_COLLIDABLE;
+    }
+    properties[EMPTY] = 0;
+    properties[ICE] = BLOCK_SOLID | BLOCK_TRANSPARENT | BLOCK_COLLIDABLE;
+    properties[WATER] = BLOCK_TRANSPARENT | BLOCK_ANIMATED | BLOCK_FLUID;
+    // Lava can be stood on
+    properties[LAVA] = BLOCK_OPAQUE | BLOCK_ANIMATED | BLOCK_FLUID | BLOCK_COLLIDABLE;
+    return properties;
+}
+
+// Central lookup for the rules every subsystem applies to block types,
+// so that meshing, physics and NPCs agree on them. Each query is a single
+// load from a 256-entry table.
+class BlockRegistry
+{
+public:
+    static constexpr unsigned char properties(BlockType t) {
+        return s_properties[t];
+    }
+    static constexpr bool has(BlockType t, BlockProperty p) {
+        return (s_properties[t] & p) != 0;
+    }
+
+    static constexpr bool isSolid(BlockType t) { return has(t, BLOCK_SOLID); }
+    static constexpr bool isOpaque(BlockType t) { return has(t, BLOCK_OPAQUE); }
+    static constexpr bool isTransparent(BlockType t) { return has(t, BLOCK_TRANSPARENT); }
+    static constexpr bool isAnimated(BlockType t) { return has(t, BLOCK_ANIMATED); }
+    static constexpr bool isFluid(BlockType t) { return has(t, BLOCK_FLUID); }
+    static constexpr bool isCollidable(BlockType t) { return has(t, BLOCK_COLLIDABLE); }
+
+private:
+    static constexpr std::array<unsigned char, 256> s_properties = makeBlockProperties();
+};
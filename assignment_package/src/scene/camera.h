@@ -21,4 +21,6 @@ public:
     void tick(float dT, InputBundle &input) override;
 
     glm::mat4 getViewProj() const;
+    // The same view with other clip planes
+    glm::mat4 getViewProj(float nearClip, float farClip) const;
 };
@@ -1,7 +1,9 @@
 #include "cave.h"
+#include "blockcursor.h"
 
 Cave::Cave(Terrain* m_terrain, int posx, int posz) :
-    m_terrain(m_terrain), posx(posx), posz(posz), radius(15), currpos(0)
+    m_terrain(m_terrain), posx(posx), posz(posz), radius(15), currpos(0),
+    random(zoneSeed(posx, posz, 2))
 {
     int startx = posx + 32;
     int startz = posz;
@@ -12,11 +14,8 @@ Cave::Cave(Terrain* m_terrain, int posx, int posz) :
 void Cave::carveOpening() {
     for (int i = -radius; i <= radius; i++) { //x
         for (int k = -radius; k <= radius; k++) { //z
-            if (i * i + k * k < radius * radius &&
-                    m_terrain->hasChunkAt(currpos.x + i, currpos.z + k)) {
-                for (int m = 118; m < 255; m++) {
-                    m_terrain->setBlockAt(currpos.x + i, m, currpos.z + k, EMPTY);
-                }
+            if (i * i + k * k < radius * radius) {
+                m_terrain->fillColumn(currpos.x + i, currpos.z + k, 118, 255, EMPTY);
             }
         }
     }
@@ -26,25 +25,27 @@ void Cave::carveOpening() {
 
 // carve a sphere around a center point with random ores
 void Cave::carveSphere() {
+    m_terrain->fillSphere(glm::ivec3(currpos), radius * radius - 1, EMPTY, BlockFilter::except(LAVA));
+
+    // Line the wall of the sphere with dirt or ores
+    BlockCursor cursor(*m_terrain);
     for (int i = -radius; i <= radius; i++) { //x
         for (int k = -radius; k <= radius; k++) { //z
-            if (m_terrain->hasChunkAt(currpos.x + i, currpos.z + k)) {
+            if (cursor.chunkAt(currpos.x + i, currpos.z + k) != nullptr) {
                 for (int j = -radius; j < radius; j++) {
-                    if (i * i + k * k + j * j < radius * radius) {
-                        if (m_terrain->getBlockAt(currpos.x + i, currpos.y + j, currpos.z + k) != LAVA)
-                            m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, EMPTY);
-                    } else if (i * i + k * k + j * j < radius * radius + 2) {
-                        if (m_terrain->getBlockAt(currpos.x + i, currpos.y + j, currpos.z + k) ==STONE)
+                    if (i * i + k * k + j * j >= radius * radius &&
+                            i * i + k * k + j * j < radius * radius + 2) {
+                        if (cursor.get(currpos.x + i, currpos.y + j, currpos.z + k) ==STONE)
                             if (currpos.y > 100) {
-                                m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, DIRT);
+                                cursor.set(currpos.x + i, currpos.y + j, currpos.z + k, DIRT);
                             } else {
-                                double random = ((double) rand() / (RAND_MAX));
-                                if (random < 0.33) {
-                                    m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, EMERALD);
-                                } else if (random < 0.66) {
-                                    m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, SAPPHIRE);
+                                double ore = std::uniform_real_distribution<double>(0, 1)(random);
+                                if (ore < 0.33) {
+                                    cursor.set(currpos.x + i, currpos.y + j, currpos.z + k, EMERALD);
+                                } else if (ore < 0.66) {
+                                    cursor.set(currpos.x + i, currpos.y + j, currpos.z + k, SAPPHIRE);
                                 } else {
-                                    m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, GOLD);
+                                    cursor.set(currpos.x + i, currpos.y + j, currpos.z + k, GOLD);
                                 }
                             }
                     }
@@ -57,17 +58,9 @@ void Cave::carveSphere() {
 
 // make a lava pool at the bottom of cave
 void Cave::drawLava() {
-    for (int i = -radius; i <= radius; i++) { //x
-        for (int k = -radius; k <= radius; k++) { //z
-            if (m_terrain->hasChunkAt(currpos.x + i, currpos.z + k)) {
-                for (int j = -radius; j < radius; j++) {
-                    if (i * i + k * k + j * j < radius * radius && j < -radius + 2) {
-                        m_terrain->setBlockAt(currpos.x + i, currpos.y + j, currpos.z + k, LAVA);
-                    }
-                }
-             }
-         }
-    }
+    // The bottom two layers of the sphere
+    m_terrain->fillSphere(glm::ivec3(currpos), radius * radius - 1, LAVA, BlockFilter::any(),
+                          currpos.y - radius, currpos.y - radius + 2);
 }
 
 // draws a cave with at most 100 iterations of carving 
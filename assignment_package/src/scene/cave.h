@@ -16,6 +16,8 @@ public:
     int startz;
     int radius;
     glm::vec3 currpos;
+    // Seeded by the zone, see zoneSeed
+    std::minstd_rand random;
     float perlinNoise3D(glm::vec3 p);
     float surflet3D(glm::vec3 p, glm::vec3 gridPoint);
     glm::vec3 random3(glm::vec3);
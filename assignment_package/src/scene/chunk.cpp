@@ -1,92 +1,165 @@
 #include "chunk.h"
+#include "blockregistry.h"
+#include "columnmask.h"
 #include "src/drawable.h"
 #include "iostream"
+#include <stdexcept>
+#include <algorithm>
 
-Chunk::Chunk(OpenGLContext* context) : Drawable(context), m_blocks(), m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}}
-{
-    std::fill_n(m_blocks.begin(), 65536, EMPTY);
+// The packed m_lifecycle word and its state byte
+static uint64_t lifecycle(ChunkState state, uint64_t generation) {
+    return generation << 8 | static_cast<uint64_t>(state);
 }
 
+static ChunkState stateOf(uint64_t lifecycle) {
+    return static_cast<ChunkState>(lifecycle & 0xff);
+}
 
-const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirection {
-    {XPOS, XNEG},
-    {XNEG, XPOS},
-    {YPOS, YNEG},
-    {YNEG, YPOS},
-    {ZPOS, ZNEG},
-    {ZNEG, ZPOS}
-};
+Chunk::Chunk(OpenGLContext* context) : Drawable(context), m_sections(16, PalettedStorage(4096, EMPTY)), m_blocksLock(), m_highestBlock(), m_lowestExposed(), m_sectionOffsets(), m_neighbors(), m_lastUsed(0), m_retired(false), m_edited(false), m_lifecycle(lifecycle(ChunkState::ALLOCATED, 0)), m_missingNeighbors(0), m_dirtySections(0), m_levelOfDetail(0)
+{
+    for (std::atomic<Chunk*> &neighbor : m_neighbors) {
+        neighbor = nullptr;
+    }
+    // Every column starts out as nothing but air
+    m_highestBlock.fill(-1);
+    m_lowestExposed.fill(0);
+}
 
+// Index of a block within its section's storage
+static inline unsigned int sectionIndex(unsigned int x, unsigned int y, unsigned int z) {
+    return x + 16 * (y & 15) + 16 * 16 * z;
+}
 
-void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
+void Chunk::linkNeighbor(Chunk *neighbor, Direction dir) {
     if(neighbor != nullptr) {
-        this->m_neighbors[dir] = neighbor.get();
-        neighbor->m_neighbors[oppositeDirection.at(dir)] = this;
+        this->m_neighbors[dir] = neighbor;
+        neighbor->m_neighbors[opposite(dir)] = this;
     }
 }
 
-Chunk::~Chunk() {}
+void Chunk::unlinkNeighbors() {
+    for (int dir : {XPOS, XNEG, ZPOS, ZNEG}) {
+        Chunk *neighbor = m_neighbors[dir].exchange(nullptr);
+        if (neighbor != nullptr) {
+            Chunk *self = this;
+            // Only if the neighbor has not been linked to a newer Chunk since
+            neighbor->m_neighbors[opposite(static_cast<Direction>(dir))]
+                    .compare_exchange_strong(self, nullptr);
+        }
+    }
+}
 
-void Chunk::create() {
+void Chunk::touch(unsigned int frame) {
+    m_lastUsed.store(frame, std::memory_order_relaxed);
+}
+
+unsigned int Chunk::lastUsed() const {
+    return m_lastUsed.load(std::memory_order_relaxed);
+}
+
+void Chunk::retire() {
+    m_retired = true;
+}
+
+bool Chunk::isRetired() const {
+    return m_retired;
+}
+
+void Chunk::markEdited() {
+    m_edited = true;
+}
+
+bool Chunk::isEdited() const {
+    return m_edited;
+}
 
-    int num_count_Opq = 0; //num increased by 4 every time for index vbo
-    int num_count_Tran = 0;
-    std::vector<glm::vec4> posOpq;
-    std::vector<glm::vec4> norOpq;
-    std::vector<glm::vec2> uvOpq;
-    std::vector<glm::vec4> posTran;
-    std::vector<glm::vec4> norTran;
-    std::vector<glm::vec2> uvTran;
-    std::vector<float> animOpq;
-    std::vector<float> animTran;
-    std::vector<float> allOpq; //interleaved
-    std::vector<float> allTran;
-    std::vector<GLuint> idxOpq;
-    std::vector<GLuint> idxTran;
-
-
-    createVBO(&posOpq,
-              &norOpq,
-              &uvOpq,
-              &animOpq,
-              &idxOpq,
-              &posTran,
-              &norTran,
-              &uvTran,
-              &animTran,
-              &idxTran);
-
-    //interleave Transparent
-    for (int i = 0; i < posTran.size(); ++i) {
-        allTran.push_back(posTran.at(i)[0]);
-        allTran.push_back(posTran.at(i)[1]);
-        allTran.push_back(posTran.at(i)[2]);
-        allTran.push_back(posTran.at(i)[3]);
-        allTran.push_back(norTran.at(i)[0]);
-        allTran.push_back(norTran.at(i)[1]);
-        allTran.push_back(norTran.at(i)[2]);
-        allTran.push_back(norTran.at(i)[3]);
-        allTran.push_back(uvTran.at(i)[0]);
-        allTran.push_back(uvTran.at(i)[1]);
-        allTran.push_back(animTran.at(i));
+ChunkState Chunk::state() const {
+    return stateOf(m_lifecycle);
+}
+
+uint64_t Chunk::generation() const {
+    return m_lifecycle >> 8;
+}
+
+void Chunk::beginGenerating() {
+    uint64_t expected = lifecycle(ChunkState::ALLOCATED, generation());
+    m_lifecycle.compare_exchange_strong(expected, lifecycle(ChunkState::GENERATING, expected >> 8));
+}
+
+void Chunk::markBlocksReady() {
+    uint64_t current = m_lifecycle;
+    if (stateOf(current) < ChunkState::BLOCKS_READY) {
+        QWriteLocker locker(&m_blocksLock);
+        compactSectionsLocked(0, 15);
     }
+    while (stateOf(current) < ChunkState::BLOCKS_READY
+           && !m_lifecycle.compare_exchange_weak(current, lifecycle(ChunkState::BLOCKS_READY, current >> 8))) {}
+}
 
-    generateIdxOpq();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxOpq);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxOpq.size() * sizeof(GLuint), idxOpq.data(), GL_STATIC_DRAW);
+bool Chunk::blocksReady() const {
+    return state() >= ChunkState::BLOCKS_READY;
+}
 
-    generateIdxTran();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTran);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxTran.size() * sizeof(GLuint), idxTran.data(), GL_STATIC_DRAW);
+uint64_t Chunk::beginMeshing() {
+    uint64_t current = m_lifecycle;
+    while (!m_lifecycle.compare_exchange_weak(current, lifecycle(ChunkState::MESHING, (current >> 8) + 1))) {}
+    return (current >> 8) + 1;
+}
 
-    generateAllOpaque();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufAllOpaque);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, allOpq.size() * sizeof(float), allOpq.data(), GL_STATIC_DRAW);
+void Chunk::finishMeshing(uint64_t generation) {
+    uint64_t expected = lifecycle(ChunkState::MESHING, generation);
+    m_lifecycle.compare_exchange_strong(expected, lifecycle(ChunkState::MESH_READY, generation));
+}
 
-    generatedAllTransparent();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufAllTransparent);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, allTran.size() * sizeof(float), allTran.data(), GL_STATIC_DRAW);
+bool Chunk::markUploaded(uint64_t generation) {
+    uint64_t current = m_lifecycle;
+    while ((current >> 8) == generation) {
+        if (stateOf(current) != ChunkState::MESH_READY
+                || m_lifecycle.compare_exchange_weak(current, lifecycle(ChunkState::UPLOADED, generation))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Chunk::markDirty(uint16_t sections) {
+    m_dirtySections |= sections;
+    uint64_t current = m_lifecycle;
+    // Chunks that were never meshed are meshed from their current blocks anyway
+    while (stateOf(current) >= ChunkState::MESHING && stateOf(current) != ChunkState::DIRTY
+           && !m_lifecycle.compare_exchange_weak(current, lifecycle(ChunkState::DIRTY, current >> 8))) {}
+}
+
+uint16_t Chunk::takeSectionsToMesh() {
+    uint16_t dirty = m_dirtySections.exchange(0);
+    if (dirty == 0 || !m_allOpaqueGenerated || !m_allTransparentGenerated) {
+        return ALL_SECTIONS;
+    }
+    return dirty;
+}
 
+bool Chunk::meshedWithout(Direction dir) const {
+    return (m_missingNeighbors >> dir) & 1;
+}
+
+Chunk* Chunk::neighbor(Direction dir) const {
+    return m_neighbors[dir];
+}
+
+Chunk::~Chunk() {}
+
+void Chunk::create() {
+    std::vector<ChunkVertex> vertOpq;
+    std::vector<ChunkVertex> vertTran;
+    SectionOffsets sections;
+
+    // Meshed and uploaded right here, so it goes through the whole pipeline at once
+    m_dirtySections = 0;
+    uint64_t generation = beginMeshing();
+    createVBO(&vertOpq, &vertTran, &sections, ALL_SECTIONS, levelOfDetail());
+    finishMeshing(generation);
+    markUploaded(generation);
+    sendToGPU(&vertOpq, &vertTran, sections);
 }
 
 GLenum Chunk::drawMode() {
@@ -99,9 +172,23 @@ void Chunk::setWorldPos(int x, int z) {
     worldP_x = 16 * xFloor;
     worldP_z = 16 * zFloor;
 }
-// Does bounds checking with at()
+
+// Blocks are drawn one unit towards -z of their grid cell
+glm::ivec3 Chunk::meshOrigin() const {
+    return glm::ivec3(worldP_x, 0, worldP_z - 1);
+}
+
+glm::ivec2 Chunk::worldPos() const {
+    return glm::ivec2(worldP_x, worldP_z);
+}
+// Does bounds checking like std::array::at()
 BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
-    return m_blocks.at(x + 16 * y + 16 * 256 * z);
+    unsigned int i = x + 16 * y + 16 * 256 * z;
+    if (i >= 65536) {
+        throw std::out_of_range("Block index " + std::to_string(i) + " is outside its Chunk!");
+    }
+    QReadLocker locker(&m_blocksLock);
+    return getBlockUnchecked(x, y, z);
 }
 
 // Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
@@ -109,982 +196,971 @@ BlockType Chunk::getBlockAt(int x, int y, int z) const {
     return getBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y), static_cast<unsigned int>(z));
 }
 
-// Does bounds checking with at()
+// Does bounds checking like std::array::at()
 void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
-    m_blocks.at(x + 16 * y + 16 * 256 * z) = t;
+    unsigned int i = x + 16 * y + 16 * 256 * z;
+    if (i >= 65536) {
+        throw std::out_of_range("Block index " + std::to_string(i) + " is outside its Chunk!");
+    }
+    QWriteLocker locker(&m_blocksLock);
+    setBlockUnchecked(x, y, z, t);
 }
 
-// MIN MS2
-void Chunk::createVBO(std::vector<glm::vec4>* posOpq,
-                      std::vector<glm::vec4>* norOpq,
-                      std::vector<glm::vec2>* uvOpq,
-                      std::vector<float> *animOpq,
-                      std::vector<GLuint>* idxOpq,
-                      std::vector<glm::vec4>* posTran,
-                      std::vector<glm::vec4>* norTran,
-                      std::vector<glm::vec2>* uvTran,
-                      std::vector<float>* animTran,
-                      std::vector<GLuint>* idxTran) {
-
-    int num_count_Opq = 0; //num increased by 4 every time for index vbo
-    int num_count_Tran = 0;
-    //find the blocktype of each block in chunk and send vbo data accordingly(Elaine1 & 2)
+void Chunk::setBlockUnchecked(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
+    m_sections[y >> 4].set(sectionIndex(x, y, z), t);
+    updateColumnMaps(x, y, z, t);
+}
+
+void Chunk::lockBlocksForReading() const {
+    m_blocksLock.lockForRead();
+}
+
+void Chunk::lockBlocksForWriting() {
+    m_blocksLock.lockForWrite();
+}
+
+void Chunk::unlockBlocks() const {
+    m_blocksLock.unlock();
+}
+
+// Placing a block can only move the maps towards it. Removing the block a
+// map points at scans on to the next block that qualifies, which terrain
+// generation and digging find within a few blocks.
+void Chunk::updateColumnMaps(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
+    auto blockAt = [&](int by) {
+        return static_cast<BlockType>(m_sections[by >> 4].get(sectionIndex(x, by, z)));
+    };
+    short &highest = m_highestBlock[x + 16 * z];
+    if (t != EMPTY) {
+        highest = std::max<short>(highest, y);
+    } else if (short(y) == highest) {
+        do {
+            --highest;
+        } while (highest >= 0 && blockAt(highest) == EMPTY);
+    }
+
+    short &lowest = m_lowestExposed[x + 16 * z];
+    if (!BlockRegistry::isOpaque(t)) {
+        lowest = std::min<short>(lowest, y);
+    } else if (short(y) == lowest) {
+        do {
+            ++lowest;
+        } while (lowest < 256 && BlockRegistry::isOpaque(blockAt(lowest)));
+    }
+}
+
+void Chunk::updateColumnMaps(int x, int z, int yMin, int yMax, BlockType t) {
+    auto blockAt = [&](int by) {
+        return static_cast<BlockType>(m_sections[by >> 4].get(sectionIndex(x, by, z)));
+    };
+    short &highest = m_highestBlock[x + 16 * z];
+    if (t != EMPTY) {
+        highest = std::max<short>(highest, yMax - 1);
+    } else if (highest >= yMin && highest < yMax) {
+        highest = yMin - 1;
+        while (highest >= 0 && blockAt(highest) == EMPTY) {
+            --highest;
+        }
+    }
+
+    short &lowest = m_lowestExposed[x + 16 * z];
+    if (!BlockRegistry::isOpaque(t)) {
+        lowest = std::min<short>(lowest, yMin);
+    } else if (lowest >= yMin && lowest < yMax) {
+        lowest = yMax;
+        while (lowest < 256 && BlockRegistry::isOpaque(blockAt(lowest))) {
+            ++lowest;
+        }
+    }
+}
+
+void Chunk::fillBox(glm::ivec3 lo, glm::ivec3 hi, BlockType t, const BlockFilter &filter) {
+    if (glm::any(glm::greaterThanEqual(lo, hi))) {
+        return;
+    }
+    QWriteLocker locker(&m_blocksLock);
+    // Generation compacts every section in markBlocksReady; later bulk
+    // writes, e.g. carving, compact the sections they touched
+    bool compactAfter = blocksReady();
+    if (!filter.acceptsAll()) {
+        for (int z = lo.z; z < hi.z; ++z) {
+            for (int y = lo.y; y < hi.y; ++y) {
+                PalettedStorage &section = m_sections[y >> 4];
+                for (int x = lo.x; x < hi.x; ++x) {
+                    unsigned int i = sectionIndex(x, y, z);
+                    if (filter.accepts(static_cast<BlockType>(section.get(i)))) {
+                        section.set(i, t);
+                        updateColumnMaps(x, y, z, t);
+                    }
+                }
+            }
+        }
+        if (compactAfter) {
+            compactSectionsLocked(lo.y >> 4, (hi.y - 1) >> 4);
+        }
+        return;
+    }
+
+    bool wholeLayers = lo.x == 0 && hi.x == 16 && lo.z == 0 && hi.z == 16;
+    for (int s = lo.y >> 4; s <= (hi.y - 1) >> 4; ++s) {
+        int yMin = std::max(lo.y, 16 * s);
+        int yMax = std::min(hi.y, 16 * s + 16);
+        PalettedStorage &section = m_sections[s];
+        if (wholeLayers && yMax - yMin == 16) {
+            section.fill(t);
+            continue;
+        }
+        // Write the box as runs along x or along y, whichever are longer
+        for (int z = lo.z; z < hi.z; ++z) {
+            if (hi.x - lo.x >= yMax - yMin) {
+                for (int y = yMin; y < yMax; ++y) {
+                    section.setRun(sectionIndex(lo.x, y, z), hi.x - lo.x, 1, t);
+                }
+            } else {
+                for (int x = lo.x; x < hi.x; ++x) {
+                    section.setRun(sectionIndex(x, yMin, z), yMax - yMin, 16, t);
+                }
+            }
+        }
+    }
+    for (int z = lo.z; z < hi.z; ++z) {
+        for (int x = lo.x; x < hi.x; ++x) {
+            updateColumnMaps(x, z, lo.y, hi.y, t);
+        }
+    }
+    if (compactAfter) {
+        compactSectionsLocked(lo.y >> 4, (hi.y - 1) >> 4);
+    }
+}
+
+void Chunk::compactSectionsLocked(int first, int last) {
+    for (int s = first; s <= last; ++s) {
+        m_sections[s].compact();
+    }
+}
+
+int Chunk::getHighestBlockAt(int x, int z) const {
+    QReadLocker locker(&m_blocksLock);
+    return m_highestBlock.at(x + 16 * z);
+}
+
+int Chunk::getLowestExposedAt(int x, int z) const {
+    QReadLocker locker(&m_blocksLock);
+    return m_lowestExposed.at(x + 16 * z);
+}
+
+void Chunk::getBlocks(BlockType *out) const {
+    std::array<unsigned char, 4096> section;
+    QReadLocker locker(&m_blocksLock);
+    for (int s = 0; s < 16; ++s) {
+        m_sections[s].decode(section.data());
+        // Each z row of a section is one contiguous run of 16 x 16 blocks in out
+        for (int z = 0; z < 16; ++z) {
+            std::copy_n(section.begin() + 16 * 16 * z, 16 * 16,
+                        reinterpret_cast<unsigned char*>(out) + 16 * 16 * s + 16 * 256 * z);
+        }
+    }
+}
+
+size_t Chunk::blockMemoryUsage() const {
+    QReadLocker locker(&m_blocksLock);
+    return sectionsMemoryUsage(m_sections);
+}
+
+size_t Chunk::sectionsMemoryUsage(const std::vector<PalettedStorage> &sections) {
+    size_t bytes = sections.capacity() * sizeof(PalettedStorage);
+    for (const PalettedStorage &section : sections) {
+        bytes += section.memoryUsage();
+    }
+    return bytes;
+}
+
+size_t Chunk::memoryUsage() const {
+    // Every quad is 4 vertices and 6 indices
+    size_t vertices = std::max(m_count_opq, 0) / 6 * 4 + std::max(m_count_tran, 0) / 6 * 4;
+    return sizeof(Chunk) + blockMemoryUsage() + vertices * sizeof(ChunkVertex);
+}
+
+std::vector<PalettedStorage> Chunk::copySections() const {
+    QReadLocker locker(&m_blocksLock);
+    return m_sections;
+}
+
+void Chunk::restoreSections(std::vector<PalettedStorage> sections) {
+    QWriteLocker locker(&m_blocksLock);
+    m_sections = std::move(sections);
+    rebuildColumnMaps();
+}
+
+void Chunk::rebuildColumnMaps() {
     for (int x = 0; x < 16; ++x) {
+        for (int z = 0; z < 16; ++z) {
+            short highest = 255;
+            while (highest >= 0 && m_sections[highest >> 4].get(sectionIndex(x, highest, z)) == EMPTY) {
+                --highest;
+            }
+            short lowest = 0;
+            while (lowest < 256 && BlockRegistry::isOpaque(static_cast<BlockType>(
+                       m_sections[lowest >> 4].get(sectionIndex(x, lowest, z))))) {
+                ++lowest;
+            }
+            m_highestBlock[x + 16 * z] = highest;
+            m_lowestExposed[x + 16 * z] = lowest;
+        }
+    }
+}
+
+bool Chunk::isSectionEmpty(int section) const {
+    QReadLocker locker(&m_blocksLock);
+    const std::vector<unsigned char> &palette = m_sections[section].palette();
+    return palette.size() == 1 && palette[0] == EMPTY;
+}
+
+// Palettes are compacted when generation finishes and after bulk writes,
+// so this only misses a section that single-block edits made opaque, and
+// it is never wrong
+bool Chunk::isSectionOpaqueLocked(int section) const {
+    for (unsigned char t : m_sections[section].palette()) {
+        if (!BlockRegistry::isOpaque(static_cast<BlockType>(t))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Index of a tile in the 16 x 16 texture atlas, counted from its lower-left corner
+static constexpr GLuint atlasTile(GLuint column, GLuint row) {
+    return column + 16 * row;
+}
+
+// Which VBO a face is drawn into, if any
+enum FaceOpacity : unsigned char {
+    HIDDEN_FACE, OPAQUE_FACE, TRANSLUCENT_FACE
+};
+
+// Everything the mesher needs to know about one face of one BlockType
+struct BlockFace {
+    GLuint tex;      // The ChunkVertex tex word without its corner bits: atlas tile and anim flag
+    FaceOpacity opacity;
+};
+
+// Face data of every possible BlockType value, indexed by [BlockType][Direction].
+// The anim flag and opacity come from the BlockRegistry; types without a tile
+// below use the atlas's first one. lambert.vert.glsl derives the position
+// inside the tile from the vertex position, so merged quads tile.
+static constexpr std::array<std::array<BlockFace, 6>, 256> makeBlockFaces() {
+    std::array<GLuint, 256> tiles {};
+    tiles[GRASS] = atlasTile(3, 15);
+    tiles[DIRT] = atlasTile(2, 15);
+    tiles[STONE] = atlasTile(1, 15);
+    tiles[SNOW] = atlasTile(2, 11);
+    tiles[ICE] = atlasTile(3, 11);
+    tiles[LAVA] = atlasTile(13, 1);
+    tiles[WATER] = atlasTile(13, 3);
+    tiles[SAND] = atlasTile(0, 4);
+    tiles[EMERALD] = atlasTile(2, 12);
+    tiles[GOLD] = atlasTile(0, 13);
+    tiles[SAPPHIRE] = atlasTile(0, 5);
+
+    std::array<std::array<BlockFace, 6>, 256> faces {};
+    for (int i = 0; i < 256; ++i) {
+        BlockType t = static_cast<BlockType>(i);
+        FaceOpacity opacity = BlockRegistry::isOpaque(t) ? OPAQUE_FACE
+                            : BlockRegistry::isTransparent(t) ? TRANSLUCENT_FACE
+                            : HIDDEN_FACE;
+        for (int dir = 0; dir < 6; ++dir) {
+            faces[t][dir] = BlockFace {tiles[t] | GLuint(BlockRegistry::isAnimated(t)) << 10, opacity};
+        }
+    }
+    faces[GRASS][YPOS].tex = atlasTile(8, 13);
+    faces[GRASS][YNEG].tex = atlasTile(2, 15);
+    return faces;
+}
+
+static constexpr std::array<std::array<BlockFace, 6>, 256> blockFaces = makeBlockFaces();
+
+// A face is drawn if its block has faces and the neighbor touching it does not hide them
+enum FaceBits : unsigned char {
+    HAS_FACES = 1, HIDES_FACES = 2
+};
+
+// The FaceBits of every possible BlockType value
+static constexpr std::array<unsigned char, 256> makeFaceBits() {
+    std::array<unsigned char, 256> bits {};
+    for (int i = 0; i < 256; ++i) {
+        BlockType t = static_cast<BlockType>(i);
+        bits[t] = (blockFaces[t][0].opacity != HIDDEN_FACE ? HAS_FACES : 0)
+                | (BlockRegistry::isOpaque(t) ? HIDES_FACES : 0);
+    }
+    return bits;
+}
+
+static constexpr std::array<unsigned char, 256> faceBits = makeFaceBits();
+
+// Corners of each face in drawing order, indexed by Direction.
+// A 1 selects the max side of the quad's box on that axis, a 0 the min side.
+static const std::array<std::array<glm::ivec3, 4>, 6> faceCorners {{
+    {{glm::ivec3(1, 0, 1), glm::ivec3(1, 0, 0), glm::ivec3(1, 1, 0), glm::ivec3(1, 1, 1)}}, // XPOS
+    {{glm::ivec3(0, 0, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 1, 1), glm::ivec3(0, 1, 0)}}, // XNEG
+    {{glm::ivec3(0, 1, 1), glm::ivec3(1, 1, 1), glm::ivec3(1, 1, 0), glm::ivec3(0, 1, 0)}}, // YPOS
+    {{glm::ivec3(0, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(1, 0, 1), glm::ivec3(0, 0, 1)}}, // YNEG
+    {{glm::ivec3(0, 0, 1), glm::ivec3(1, 0, 1), glm::ivec3(1, 1, 1), glm::ivec3(0, 1, 1)}}, // ZPOS
+    {{glm::ivec3(1, 0, 0), glm::ivec3(0, 0, 0), glm::ivec3(0, 1, 0), glm::ivec3(1, 1, 0)}}  // ZNEG
+}};
+
+// The vectors createVBO writes into, indexed by the FaceOpacity of a face
+struct MeshTarget {
+    std::array<std::vector<ChunkVertex>*, 3> vert;
+};
+
+// The input of one mesh job: the Chunk's blocks plus a one block border
+// copied from its four neighbors, 18 x 256 x 18 in all. The mesher reads
+// this one array instead of locking Chunks or following neighbor pointers,
+// and nothing another thread writes while it runs can reach it.
+// Borders of missing neighbors hold EMPTY, as do the four corner columns,
+// which no face touches.
+struct MeshSnapshot {
+    static const int SIDE = 18;
+    std::array<BlockType, SIDE * 256 * SIDE> blocks;
+    // Per column (x + 16 * z), the lowest and highest y of a block that can have a visible face
+    std::array<short, 256> lo;
+    std::array<short, 256> hi;
+    // The sections that can have visible faces at all
+    std::array<bool, 16> meshable;
+    // Per column (x + 16 * z) and Direction, the blocks whose face on that side is drawn
+    std::array<std::array<ColumnMask, 6>, 256> faces;
+    // Per section, bit i is set if any block at y = 16 * section + i has a face drawn
+    std::array<uint16_t, 16> faceRows;
+
+    // x and z may be -1 or 16
+    BlockType at(int x, int y, int z) const {
+        return blocks[(x + 1) + SIDE * y + SIDE * 256 * (z + 1)];
+    }
+    bool hasFace(Direction dir, int x, int y, int z) const {
+        return faces[x + 16 * z][dir].test(y);
+    }
+};
+
+// Snapshots are large, so each thread reuses its own
+static MeshSnapshot& threadSnapshot() {
+    thread_local uPtr<MeshSnapshot> snapshot = mkU<MeshSnapshot>();
+    return *snapshot;
+}
+
+// Appends one quad covering the side of the block box [lo, hi) that faces dir
+// to the VBO its face's FaceOpacity selects. lo and hi are chunk-local block
+// coordinates, so every corner lies in [0, 16] x [0, 256] x [0, 16]
+// (see ChunkVertex in chunk.h for the bit layout).
+static void appendQuad(const MeshTarget &m, Direction dir, BlockType t,
+                       glm::ivec3 lo, glm::ivec3 hi) {
+    const BlockFace &face = blockFaces[t][dir];
+    std::vector<ChunkVertex> *vert = m.vert[face.opacity];
+
+    for (GLuint i = 0; i < 4; ++i) {
+        glm::ivec3 p = lo + faceCorners[dir][i] * (hi - lo);
+        ChunkVertex v;
+        v.pos = GLuint(p.x) | GLuint(p.y) << 5 | GLuint(p.z) << 14 | GLuint(dir) << 19;
+        v.tex = face.tex | i << 8;
+        vert->push_back(v);
+    }
+}
+
+std::atomic_bool Chunk::s_greedyMeshing(false);
+
+void Chunk::setGreedyMeshing(bool enabled) {
+    s_greedyMeshing = enabled;
+}
+
+bool Chunk::greedyMeshing() {
+    return s_greedyMeshing;
+}
+
+void Chunk::setLevelOfDetail(int level) {
+    m_levelOfDetail = static_cast<unsigned char>(level);
+}
+
+int Chunk::levelOfDetail() const {
+    return m_levelOfDetail;
+}
+
+// Nothing above a column's highest block is drawn. A block can only have a
+// visible face if it is at or above the lowest exposed block of its own
+// column or of a horizontally adjacent one, or sits right below it.
+// A section is skipped if it is all air, or if it and the six sections
+// around it are opaque, so none of its faces can be seen.
+void Chunk::takeSnapshot(MeshSnapshot *snapshot) const {
+    const int side = MeshSnapshot::SIDE;
+    unsigned char *out = reinterpret_cast<unsigned char*>(snapshot->blocks.data());
+    std::array<short, 256> ownLowest;
+    std::array<bool, 16> empty;
+    std::array<bool, 16> opaque;
+    {
+        QReadLocker locker(&m_blocksLock);
+        // Decode the palette-compressed blocks once instead of on every lookup
+        std::array<unsigned char, 4096> section;
+        for (int s = 0; s < 16; ++s) {
+            m_sections[s].decode(section.data());
+            for (int z = 0; z < 16; ++z) {
+                for (int y = 0; y < 16; ++y) {
+                    std::copy_n(section.begin() + 16 * y + 16 * 16 * z, 16,
+                                out + 1 + side * (16 * s + y) + side * 256 * (z + 1));
+                }
+            }
+            const std::vector<unsigned char> &palette = m_sections[s].palette();
+            empty[s] = palette.size() == 1 && palette[0] == EMPTY;
+            opaque[s] = isSectionOpaqueLocked(s);
+        }
+        snapshot->hi = m_highestBlock;
+        ownLowest = m_lowestExposed;
+    }
+
+    // The column of the neighbor across dir that touches this Chunk's
+    // column i along that edge, and where it goes in the snapshot
+    auto edgeColumn = [](Direction dir, int i, glm::ivec2 *neighbor, glm::ivec2 *padded) {
+        switch (dir) {
+        case XPOS: *neighbor = glm::ivec2(0, i); *padded = glm::ivec2(16, i); break;
+        case XNEG: *neighbor = glm::ivec2(15, i); *padded = glm::ivec2(-1, i); break;
+        case ZPOS: *neighbor = glm::ivec2(i, 0); *padded = glm::ivec2(i, 16); break;
+        default: *neighbor = glm::ivec2(i, 15); *padded = glm::ivec2(i, -1); break;
+        }
+    };
+    // Per direction and position along the edge, the lowest exposed y of
+    // the neighbor's column; a missing neighbor reads as EMPTY
+    std::array<std::array<short, 16>, 6> edgeLowest {};
+    bool enclosedSides[16];
+    std::fill_n(enclosedSides, 16, true);
+    // Every side counts as missing until its neighbor has been read, so
+    // whoever marks a neighbor ready after we looked at it sees the bit
+    const unsigned char allSides = 1 << XPOS | 1 << XNEG | 1 << ZPOS | 1 << ZNEG;
+    m_missingNeighbors = allSides;
+    unsigned char missing = 0;
+    for (Direction dir : {XPOS, XNEG, ZPOS, ZNEG}) {
+        const Chunk *c = m_neighbors[dir];
+        glm::ivec2 n, p;
+        // A neighbor still being generated may hold half its blocks
+        if (c == nullptr || !c->blocksReady()) {
+            missing |= 1 << dir;
+            std::fill_n(enclosedSides, 16, false);
+            for (int i = 0; i < 16; ++i) {
+                edgeColumn(dir, i, &n, &p);
+                for (int y = 0; y < 256; ++y) {
+                    out[(p.x + 1) + side * y + side * 256 * (p.y + 1)] = EMPTY;
+                }
+            }
+            continue;
+        }
+        QReadLocker locker(&c->m_blocksLock);
+        for (int i = 0; i < 16; ++i) {
+            edgeColumn(dir, i, &n, &p);
             for (int y = 0; y < 256; ++y) {
-                for (int z = 0; z < 16; ++z) {
+                out[(p.x + 1) + side * y + side * 256 * (p.y + 1)] =
+                        c->m_sections[y >> 4].get(sectionIndex(n.x, y, n.y));
+            }
+            edgeLowest[dir][i] = c->m_lowestExposed[n.x + 16 * n.y];
+        }
+        for (int s = 0; s < 16; ++s) {
+            enclosedSides[s] = enclosedSides[s] && c->isSectionOpaqueLocked(s);
+        }
+    }
+    m_missingNeighbors = missing;
 
-                    std::vector<glm::vec4> *pos;
-                    std::vector<glm::vec4> *nor;
-                    std::vector<glm::vec2> *uv;
-                    std::vector<float> *anim;
+    auto lowestExposed = [&](int x, int z) -> int {
+        if (x < 0) return edgeLowest[XNEG][z];
+        if (x > 15) return edgeLowest[XPOS][z];
+        if (z < 0) return edgeLowest[ZNEG][x];
+        if (z > 15) return edgeLowest[ZPOS][x];
+        return ownLowest[x + 16 * z];
+    };
+    for (int z = 0; z < 16; ++z) {
+        for (int x = 0; x < 16; ++x) {
+            int lo = std::min({lowestExposed(x, z),
+                               lowestExposed(x + 1, z), lowestExposed(x - 1, z),
+                               lowestExposed(x, z + 1), lowestExposed(x, z - 1)});
+            snapshot->lo[x + 16 * z] = std::max(lo - 1, 0);
+        }
+    }
 
-                    int num = 0; //num of faces in each block that we want to save data
-                    BlockType t = getBlockAt(x, y, z);
-                    if (t == EMPTY) {
-                        continue;
-                    } else if (t == GRASS || t == DIRT || t == STONE || t == SNOW || t == LAVA || t == SAND
-                               || t == EMERALD || t == GOLD || t == SAPPHIRE) {
-                        pos = posOpq;
-                        nor = norOpq;
-                        uv = uvOpq;
-                        anim = animOpq;
-                    } else {
-                        pos =posTran;
-                        nor =norTran;
-                        uv = uvTran;
-                        anim =animTran;
-                    }
+    for (int s = 0; s < 16; ++s) {
+        // The bottom of the world and the sky above it count as see-through
+        bool enclosed = s != 0 && s != 15 && opaque[s] && opaque[s - 1] && opaque[s + 1]
+                && enclosedSides[s];
+        snapshot->meshable[s] = !empty[s] && !enclosed;
+    }
+}
 
-                    // to create vbo data for 6 faces
-                    BlockType topBlock = EMPTY;
-                    if (y == 255) {
-                        topBlock = EMPTY;
-                    } else {
-                        topBlock = getBlockAt(x, y+1, z);
-                    }
+// Calls f(from, to) for every run of rows [from, to] within [lo, hi] that
+// lies in one of the sections of sectionMask
+template <class F>
+static void forEachRun(uint16_t sectionMask, int lo, int hi, F f) {
+    lo = std::max(lo, 0);
+    hi = std::min(hi, 255);
+    for (int s = lo >> 4; s <= hi >> 4; ++s) {
+        if ((sectionMask >> s) & 1) {
+            f(std::max(lo, 16 * s), std::min(hi, 16 * s + 15));
+        }
+    }
+}
 
-                    BlockType botBlock = EMPTY;
-                    if (y == 0) {
-                        botBlock = EMPTY;
-                    } else {
-                        botBlock = getBlockAt(x, y-1, z);
-                    }
+// Fills in the faces of the snapshot's sections in sectionMask; the faces
+// of the other sections are left undefined. Each column's blocks are turned
+// into one bitmask of blocks with faces and one of blocks that hide faces.
+// The faces of each side then come from the whole column at once: ANDing
+// with the shifted mask of the column itself for +-y, and with the mask of
+// the adjacent column for +-x and +-z.
+// Only the blocks between a column's bounds can have a visible face, plus
+// the one at y = 0, whose bottom face looks out of the world, so only those
+// and the blocks next to them are read.
+static void findFaces(MeshSnapshot *snapshot, uint16_t sectionMask) {
+    const int side = MeshSnapshot::SIDE;
+    auto padded = [](int x, int z) {
+        return (x + 1) + side * (z + 1);
+    };
+    // The rows to read per padded column: those of the column itself and
+    // of its four neighbors, one further up and down
+    std::array<short, side * side> readLo;
+    std::array<short, side * side> readHi;
+    readLo.fill(256);
+    readHi.fill(-1);
+    for (int z = 0; z < 16; ++z) {
+        for (int x = 0; x < 16; ++x) {
+            int lo = snapshot->lo[x + 16 * z] - 1;
+            int hi = snapshot->hi[x + 16 * z] + 1;
+            for (int p : {padded(x, z), padded(x + 1, z), padded(x - 1, z), padded(x, z + 1), padded(x, z - 1)}) {
+                readLo[p] = std::min<int>(readLo[p], lo);
+                readHi[p] = std::max<int>(readHi[p], hi);
+            }
+        }
+    }
+    const uint16_t readSections = sectionMask | sectionMask << 1 | sectionMask >> 1;
+    const bool bottom = sectionMask & 1;
 
-                    BlockType rightBlock = EMPTY;
-                    if (x == 15) {
-                        Chunk *rightNeighbor = m_neighbors.at(XPOS);
-                        if (rightNeighbor != nullptr) {
-                            rightBlock = rightNeighbor->getBlockAt((x+1)%16, y, z);
-                        }
-                    } else {
-                        rightBlock = getBlockAt(x + 1, y, z);
-                    }
+    std::array<ColumnMask, 256> hasFaces {};
+    std::array<ColumnMask, side * side> hidesFaces {};
+    // Blocks with faces in the padding are never meshed
+    ColumnMask paddingHasFaces;
+    for (int z = -1; z <= 16; ++z) {
+        for (int x = -1; x <= 16; ++x) {
+            bool inside = x >= 0 && x <= 15 && z >= 0 && z <= 15;
+            ColumnMask &has = inside ? hasFaces[x + 16 * z] : paddingHasFaces;
+            ColumnMask &hides = hidesFaces[padded(x, z)];
+            int hasLo = inside ? snapshot->lo[x + 16 * z] : 256;
+            int hasHi = inside ? snapshot->hi[x + 16 * z] : -1;
+            const BlockType *column = snapshot->blocks.data() + (x + 1) + side * 256 * (z + 1);
 
-                    BlockType leftBlock = EMPTY;
-                    if (x == 0) {
-                        Chunk *leftNeighbor = m_neighbors.at(XNEG);
-                        if (leftNeighbor != nullptr) {
-                            leftBlock = leftNeighbor->getBlockAt(15, y, z);
-                        }
-                    } else {
-                        leftBlock = getBlockAt(x - 1, y, z);
-                    }
+            if (bottom) {
+                unsigned int bits0 = faceBits[column[0]];
+                unsigned int bits1 = faceBits[column[side]];
+                hides.words[0] |= (bits0 >> 1) | (bits1 >> 1) << 1;
+                has.words[0] |= bits0 & HAS_FACES;
+            }
+            forEachRun(readSections, readLo[padded(x, z)], readHi[padded(x, z)], [&](int from, int to) {
+                for (int y = from; y <= to; ++y) {
+                    unsigned int bits = faceBits[column[side * y]];
+                    unsigned int hasRow = y >= hasLo && y <= hasHi;
+                    hides.words[y >> 6] |= uint64_t(bits >> 1) << (y & 63);
+                    has.words[y >> 6] |= uint64_t(bits & hasRow) << (y & 63);
+                }
+            });
+        }
+    }
 
-                    BlockType frontBlock = EMPTY;
-                    if (z == 15) {
-                        Chunk *frontNeighbor = m_neighbors.at(ZPOS);
-                        if (frontNeighbor != nullptr) {
-                            frontBlock = frontNeighbor->getBlockAt(x, y, 0);
-                        }
-                    } else {
-                        frontBlock = getBlockAt(x, y, z+1);
-                    }
+    // Rows with any face, of every column
+    ColumnMask anyFace {};
+    for (int z = 0; z < 16; ++z) {
+        for (int x = 0; x < 16; ++x) {
+            const ColumnMask &has = hasFaces[x + 16 * z];
+            const ColumnMask &hides = hidesFaces[padded(x, z)];
+            std::array<ColumnMask, 6> &faces = snapshot->faces[x + 16 * z];
+            faces[XPOS] = andNot(has, hidesFaces[padded(x + 1, z)]);
+            faces[XNEG] = andNot(has, hidesFaces[padded(x - 1, z)]);
+            faces[YPOS] = andNot(has, shiftedDown(hides));
+            faces[YNEG] = andNot(has, shiftedUp(hides));
+            faces[ZPOS] = andNot(has, hidesFaces[padded(x, z + 1)]);
+            faces[ZNEG] = andNot(has, hidesFaces[padded(x, z - 1)]);
+            for (const ColumnMask &f : faces) {
+                for (int i = 0; i < 4; ++i) {
+                    anyFace.words[i] |= f.words[i];
+                }
+            }
+        }
+    }
+    for (int s = 0; s < 16; ++s) {
+        snapshot->faceRows[s] = anyFace.section(s);
+    }
+}
 
-                    BlockType backBlock = EMPTY;
-                    if (z == 0) {
-                        Chunk *backNeighbor = m_neighbors.at(ZNEG);
-                        if (backNeighbor != nullptr) {
-                            backBlock = backNeighbor->getBlockAt(x, y, 15);
+// The blocks of a Chunk downsampled for a coarser level of detail: each
+// cell of scale x scale x scale blocks becomes one block
+struct LodGrid {
+    int scale;
+    // Cells on a horizontal side, and cells tall
+    int size;
+    int height;
+    std::array<BlockType, 8 * 128 * 8> cells;
+
+    BlockType at(int x, int y, int z) const {
+        return cells[x + size * y + size * height * z];
+    }
+};
+
+// A cell is solid if at least half of its blocks have faces. A solid cell
+// takes the type most of its columns show on top, so the surface keeps
+// its look from afar rather than turning into the dirt and stone below.
+static void downsample(const MeshSnapshot &snapshot, int scale, LodGrid *grid) {
+    grid->scale = scale;
+    grid->size = 16 / scale;
+    grid->height = 256 / scale;
+    const int volume = scale * scale * scale;
+    // Per column of the cell, the type on top and how many columns share it
+    std::vector<std::pair<BlockType, int>> votes;
+    votes.reserve(scale * scale);
+    for (int cz = 0; cz < grid->size; ++cz) {
+        for (int cx = 0; cx < grid->size; ++cx) {
+            // Everything above the highest block of the cell's columns is EMPTY
+            int top = -1;
+            for (int z = cz * scale; z < (cz + 1) * scale; ++z) {
+                for (int x = cx * scale; x < (cx + 1) * scale; ++x) {
+                    top = std::max<int>(top, snapshot.hi[x + 16 * z]);
+                }
+            }
+            for (int cy = 0; cy < grid->height; ++cy) {
+                BlockType cell = EMPTY;
+                if (cy * scale <= top) {
+                    int solid = 0;
+                    votes.clear();
+                    for (int z = cz * scale; z < (cz + 1) * scale; ++z) {
+                        for (int x = cx * scale; x < (cx + 1) * scale; ++x) {
+                            BlockType columnTop = EMPTY;
+                            for (int y = cy * scale; y < (cy + 1) * scale; ++y) {
+                                BlockType t = snapshot.at(x, y, z);
+                                if (faceBits[t] & HAS_FACES) {
+                                    ++solid;
+                                    columnTop = t;
+                                }
+                            }
+                            if (columnTop == EMPTY) {
+                                continue;
+                            }
+                            auto vote = std::find_if(votes.begin(), votes.end(), [columnTop](const std::pair<BlockType, int> &v) {
+                                return v.first == columnTop;
+                            });
+                            if (vote == votes.end()) {
+                                votes.emplace_back(columnTop, 1);
+                            } else {
+                                ++vote->second;
+                            }
                         }
-                    } else {
-                        backBlock = getBlockAt(x, y, z-1);
                     }
+                    if (2 * solid >= volume) {
+                        cell = std::max_element(votes.begin(), votes.end(), [](const std::pair<BlockType, int> &a,
+                                                                               const std::pair<BlockType, int> &b) {
+                            return a.second < b.second;
+                        })->first;
+                    }
+                }
+                grid->cells[cx + grid->size * cy + grid->size * grid->height * cz] = cell;
+            }
+        }
+    }
+}
 
-                    if (topBlock == EMPTY || topBlock == WATER || topBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(0.f, 1.f, 0.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y+1, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y+1, z + worldP_z -1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z-1, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(8.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(9.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(9.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(8.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
+static const std::array<glm::ivec3, 6> directionOffset {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0),
+    glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0),
+    glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)
+};
 
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
+// How far below the neighbor's visible blocks the sides along a Chunk
+// border are drawn at a coarser level of detail: the most a surface can
+// move when it is downsampled at the coarsest level
+static const int SKIRT_DEPTH = 1 << Chunk::MAX_LEVEL_OF_DETAIL;
 
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
+// Does any block of the neighbor across dir that touches the side of the
+// box [lo, lo + scale) show, or any of the SKIRT_DEPTH blocks above those?
+static bool isBorderExposed(const MeshSnapshot &snapshot, Direction dir, glm::ivec3 lo, int scale) {
+    int yEnd = std::min(lo.y + scale + SKIRT_DEPTH, 256);
+    for (int i = 0; i < scale; ++i) {
+        glm::ivec2 n;
+        switch (dir) {
+        case XPOS: n = glm::ivec2(16, lo.z + i); break;
+        case XNEG: n = glm::ivec2(-1, lo.z + i); break;
+        case ZPOS: n = glm::ivec2(lo.x + i, 16); break;
+        default: n = glm::ivec2(lo.x + i, -1); break;
+        }
+        for (int y = lo.y; y < yEnd; ++y) {
+            if (!(faceBits[snapshot.at(n.x, y, n.y)] & HIDES_FACES)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
+// Appends the quads of one section at a coarser level of detail, one per
+// visible side of each solid cell. The neighbors' cells are unknown and
+// may be meshed at another level, so a side on the Chunk's border is drawn
+// wherever the neighbor's blocks next to it, or some above them, show:
+// this hangs a skirt down into any crack between the two meshes.
+static void meshLodSection(const MeshTarget &target, const MeshSnapshot &snapshot,
+                           const LodGrid &grid, int section) {
+    const std::array<Direction, 6> faceOrder {YPOS, YNEG, XPOS, XNEG, ZPOS, ZNEG};
+    const int scale = grid.scale;
+    for (int cx = 0; cx < grid.size; ++cx) {
+        for (int cz = 0; cz < grid.size; ++cz) {
+            for (int cy = 16 * section / scale; cy < 16 * (section + 1) / scale; ++cy) {
+                BlockType t = grid.at(cx, cy, cz);
+                if (!(faceBits[t] & HAS_FACES)) {
+                    continue;
+                }
+                glm::ivec3 cell(cx, cy, cz);
+                for (Direction dir : faceOrder) {
+                    glm::ivec3 n = cell + directionOffset[dir];
+                    bool visible;
+                    if (n.y < 0 || n.y >= grid.height) {
+                        visible = true;
+                    } else if (n.x < 0 || n.x >= grid.size || n.z < 0 || n.z >= grid.size) {
+                        visible = isBorderExposed(snapshot, dir, cell * scale, scale);
+                    } else {
+                        visible = !(faceBits[grid.at(n.x, n.y, n.z)] & HIDES_FACES);
+                    }
+                    if (visible) {
+                        appendQuad(target, dir, t, cell * scale, (cell + glm::ivec3(1)) * scale);
+                    }
+                }
+            }
+        }
+    }
+}
 
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
+// MIN MS2
+void Chunk::createVBO(std::vector<ChunkVertex>* vertOpq,
+                      std::vector<ChunkVertex>* vertTran,
+                      SectionOffsets* sections,
+                      uint16_t sectionMask,
+                      int levelOfDetail) {
+    MeshTarget target {{nullptr, vertOpq, vertTran}};
+    MeshSnapshot &snapshot = threadSnapshot();
+    takeSnapshot(&snapshot);
+    // Coarser levels are meshed cell by cell from a downsampled copy of the blocks
+    LodGrid lodGrid;
+    if (levelOfDetail > 0) {
+        downsample(snapshot, 1 << levelOfDetail, &lodGrid);
+    } else {
+        uint16_t meshableMask = 0;
+        for (int s = 0; s < 16; ++s) {
+            meshableMask |= uint16_t(snapshot.meshable[s]) << s;
+        }
+        findFaces(&snapshot, sectionMask & meshableMask);
+    }
 
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
+    for (int s = 0; s < 16; ++s) {
+        sections->opq[s] = vertOpq->size();
+        sections->tran[s] = vertTran->size();
+        if (!((sectionMask >> s) & 1)) {
+            continue;
+        }
+        if (levelOfDetail > 0) {
+            meshLodSection(target, snapshot, lodGrid, s);
+        } else {
+            meshSection(target, snapshot, s);
+        }
+    }
+    sections->opq[16] = vertOpq->size();
+    sections->tran[16] = vertTran->size();
+}
 
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
-                            break;
+// Appends the quads of one 16 x 16 x 16 section. Sections of air and
+// sections buried in opaque blocks have no visible faces and are skipped.
+// Within a section, only the blocks with a face drawn are visited.
+void Chunk::meshSection(const MeshTarget &target, const MeshSnapshot &snapshot, int section) {
+    if (!snapshot.meshable[section]) {
+        return;
+    }
+
+    if (greedyMeshing()) {
+        createGreedySection(target, snapshot, section);
+    } else {
+        //find the blocktype of each block in chunk and send vbo data accordingly(Elaine1 & 2)
+        const std::array<Direction, 6> faceOrder {YPOS, YNEG, XPOS, XNEG, ZPOS, ZNEG};
+        for (int x = 0; x < 16; ++x) {
+            for (int z = 0; z < 16; ++z) {
+                const std::array<ColumnMask, 6> &faces = snapshot.faces[x + 16 * z];
+                std::array<uint16_t, 6> rows;
+                uint32_t anyFace = 0;
+                for (int dir = 0; dir < 6; ++dir) {
+                    rows[dir] = faces[dir].section(section);
+                    anyFace |= rows[dir];
+                }
+                while (anyFace != 0) {
+                    int i = lowestBit(anyFace);
+                    anyFace &= anyFace - 1;
+                    glm::ivec3 p(x, 16 * section + i, z);
+                    BlockType t = snapshot.at(p.x, p.y, p.z);
+                    for (Direction dir : faceOrder) {
+                        if ((rows[dir] >> i) & 1) {
+                            appendQuad(target, dir, t, p, p + glm::ivec3(1));
                         }
                     }
-                    if (botBlock == EMPTY || botBlock == WATER || botBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(0.f, -1.f, 0.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
-                            break;
-                        }
+                }
+            }
+        }
+    }
+}
+
+// Greedy meshing: for every slice of the section perpendicular to a face
+// direction, build a mask of the visible faces in that slice and merge
+// rectangles of identical block type into a single quad. Faces of one block
+// type share their texture, anim flag and opaque/transparent pass, so merged
+// quads look the same as the per-block faces they replace.
+void Chunk::createGreedySection(const MeshTarget &target, const MeshSnapshot &snapshot, int section) {
+    // Only the layers between the lowest and highest one with a face are meshed
+    uint16_t rows = snapshot.faceRows[section];
+    if (rows == 0) {
+        return;
+    }
+    int lo = 16 * section + lowestBit(rows);
+    int hi = 16 * section + 15;
+    while (!((rows >> (hi - 16 * section)) & 1)) {
+        --hi;
+    }
+    const glm::ivec3 size(16, hi - lo + 1, 16);
+    const glm::ivec3 base(0, lo, 0);
+    std::array<BlockType, 16 * 16> mask;
+
+    for (int d = 0; d < 6; ++d) {
+        Direction dir = static_cast<Direction>(d);
+        // axis is perpendicular to the face, u and v span the slice
+        int axis = d / 2;
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        for (int s = 0; s < size[axis]; ++s) {
+            glm::ivec3 p;
+            p[axis] = s;
+            for (int j = 0; j < size[v]; ++j) {
+                for (int i = 0; i < size[u]; ++i) {
+                    p[u] = i;
+                    p[v] = j;
+                    glm::ivec3 b = base + p;
+                    bool visible = snapshot.hasFace(dir, b.x, b.y, b.z);
+                    mask[i + j * size[u]] = visible ? snapshot.at(b.x, b.y, b.z) : EMPTY;
+                }
+            }
+
+            for (int j = 0; j < size[v]; ++j) {
+                for (int i = 0; i < size[u]; ) {
+                    BlockType t = mask[i + j * size[u]];
+                    if (t == EMPTY) {
+                        ++i;
+                        continue;
                     }
-                    if (rightBlock == EMPTY || rightBlock == WATER || rightBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(1.f, 0.f, 0.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y+1, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y+1, z + worldP_z, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
-                            break;
-                        }
+                    int w = 1;
+                    while (i + w < size[u] && mask[i + w + j * size[u]] == t) {
+                        ++w;
                     }
-                    if (leftBlock == EMPTY || leftBlock == WATER || leftBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(-1.f, 0.f, 0.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z - 1, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
-                            break;
+                    int h = 1;
+                    for (; j + h < size[v]; ++h) {
+                        bool rowMatches = true;
+                        for (int k = 0; k < w; ++k) {
+                            if (mask[i + k + (j + h) * size[u]] != t) {
+                                rowMatches = false;
+                                break;
+                            }
                         }
-                    }
-                    if (frontBlock == EMPTY || frontBlock == WATER || frontBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(0.f, 0.f, 1.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y+1, z + worldP_z, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
+                        if (!rowMatches) {
                             break;
                         }
                     }
-                    if (backBlock == EMPTY || backBlock == WATER || backBlock == ICE) {
-                        num++;
-                        glm::vec4 normal(0.f, 0.f, -1.f, 0.f);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-                        nor->push_back(normal);
-
-                        pos->push_back(glm::vec4(x + worldP_x + 1, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x, y+1, z + worldP_z - 1, 1.f));
-                        pos->push_back(glm::vec4(x + worldP_x+1, y+1, z + worldP_z - 1, 1.f));
-
-                        switch(t) {
-                        case GRASS:
-                            //col->push_back(glm::vec4(95.f, 159.f, 53.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case DIRT:
-                            //col->push_back(glm::vec4(121.f, 85.f, 58.f, 255.f) / 255.f);
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case STONE:
-                            //col->push_back(glm::vec4(0.5f));
-                            uv->push_back(glm::vec2(1.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 15.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 16.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 16.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SNOW:
-                            //col->push_back(glm::vec4(1.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case ICE:
-                            uv->push_back(glm::vec2(3.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 11.f/16.f));
-                            uv->push_back(glm::vec2(4.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case LAVA:
-                            uv->push_back(glm::vec2(13.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 2.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 2.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case WATER:
-                            uv->push_back(glm::vec2(13.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 3.f/16.f));
-                            uv->push_back(glm::vec2(14.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(13.f/16.f, 4.f/16.f));
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            anim->push_back(1.f);
-                            break;
-                        case SAND:
-                            uv->push_back(glm::vec2(0.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 4.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case EMERALD:
-                            uv->push_back(glm::vec2(2.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 12.f/16.f));
-                            uv->push_back(glm::vec2(3.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(2.f/16.f, 13.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case GOLD:
-                            uv->push_back(glm::vec2(0.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 13.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 14.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 14.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        case SAPPHIRE:
-                            uv->push_back(glm::vec2(0.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 5.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 6.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 6.f/16.f));
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            anim->push_back(0.f);
-                            break;
-                        default:
-                            uv->push_back(glm::vec2(0.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 0.f/16.f));
-                            uv->push_back(glm::vec2(1.f/16.f, 1.f/16.f));
-                            uv->push_back(glm::vec2(0.f/16.f, 1.f/16.f));
-                            break;
+                    for (int l = 0; l < h; ++l) {
+                        for (int k = 0; k < w; ++k) {
+                            mask[i + k + (j + l) * size[u]] = EMPTY;
                         }
                     }
 
-                    //push back indices
-                    if (t == WATER || t == ICE) {
-                        for (int i = 0; i < num; i++) {
-                            idxTran->push_back(num_count_Tran);
-                            idxTran->push_back(num_count_Tran + 1);
-                            idxTran->push_back(num_count_Tran + 2);
-                            idxTran->push_back(num_count_Tran);
-                            idxTran->push_back(num_count_Tran + 2);
-                            idxTran->push_back(num_count_Tran + 3);
-
-                            num_count_Tran = num_count_Tran + 4;
-                        }
-                    } else {
-                        for (int i = 0; i < num; i++) {
-                            idxOpq->push_back(num_count_Opq);
-                            idxOpq->push_back(num_count_Opq + 1);
-                            idxOpq->push_back(num_count_Opq + 2);
-                            idxOpq->push_back(num_count_Opq);
-                            idxOpq->push_back(num_count_Opq + 2);
-                            idxOpq->push_back(num_count_Opq + 3);
-
-                            num_count_Opq = num_count_Opq + 4;
-                        }
-
-                    }
+                    glm::ivec3 lo, hi;
+                    lo[axis] = s;
+                    hi[axis] = s + 1;
+                    lo[u] = i;
+                    hi[u] = i + w;
+                    lo[v] = j;
+                    hi[v] = j + h;
+                    appendQuad(target, dir, t, base + lo, base + hi);
+                    i += w;
                 }
             }
         }
-    m_count_opq = idxOpq->size();
-    m_count_tran = idxTran->size();
+    }
 }
 
 //send the created vbo data
-void Chunk::sendToGPU(std::vector<float>* allOpq,
-                      std::vector<GLuint>* idxOpq,
-                      std::vector<float>* allTran,
-                      std::vector<GLuint>* idxTran) {
-
-    generateIdxOpq();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxOpq);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxOpq->size() * sizeof(GLuint), idxOpq->data(), GL_STATIC_DRAW);
-
-    generateIdxTran();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTran);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, idxTran->size() * sizeof(GLuint), idxTran->data(), GL_STATIC_DRAW);
+void Chunk::sendToGPU(std::vector<ChunkVertex>* vertOpq,
+                      std::vector<ChunkVertex>* vertTran,
+                      const SectionOffsets &sections,
+                      uint16_t sectionMask) {
+    if (sectionMask == ALL_SECTIONS) {
+        replaceBuffer(m_bufAllOpaque, m_allOpaqueGenerated, *vertOpq);
+        replaceBuffer(m_bufAllTransparent, m_allTransparentGenerated, *vertTran);
+        m_sectionOffsets = sections;
+    } else {
+        spliceSections(m_bufAllOpaque, m_sectionOffsets.opq, sectionMask, *vertOpq, sections.opq);
+        spliceSections(m_bufAllTransparent, m_sectionOffsets.tran, sectionMask, *vertTran, sections.tran);
+    }
+    // Six indices per quad of four vertices
+    m_count_opq = m_sectionOffsets.opq[16] / 4 * 6;
+    m_count_tran = m_sectionOffsets.tran[16] / 4 * 6;
+}
 
-    generateAllOpaque();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufAllOpaque);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, allOpq->size() * sizeof(float), allOpq->data(), GL_STATIC_DRAW);
+// The first upload fills the buffer it creates; later ones build the new
+// mesh in a buffer of its own while the old one can still be drawn from
+void Chunk::replaceBuffer(GLuint &buffer, bool &generated, const std::vector<ChunkVertex> &verts) {
+    GLuint replacement;
+    mp_context->glGenBuffers(1, &replacement);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, replacement);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(ChunkVertex), verts.data(), GL_STATIC_DRAW);
+    if (generated) {
+        mp_context->glDeleteBuffers(1, &buffer);
+    }
+    buffer = replacement;
+    generated = true;
+}
 
-    generatedAllTransparent();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufAllTransparent);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, allTran->size() * sizeof(float), allTran->data(), GL_STATIC_DRAW);
+void Chunk::spliceSections(GLuint &buffer, std::array<unsigned int, 17> &offsets,
+                           uint16_t sectionMask, const std::vector<ChunkVertex> &verts,
+                           const std::array<unsigned int, 17> &vertOffsets) {
+    const GLsizeiptr vertexSize = sizeof(ChunkVertex);
+    auto replaced = [sectionMask](int s) {
+        return (sectionMask >> s) & 1;
+    };
+    std::array<unsigned int, 17> spliced;
+    spliced[0] = 0;
+    for (int s = 0; s < 16; ++s) {
+        spliced[s + 1] = spliced[s] + (replaced(s) ? vertOffsets[s + 1] - vertOffsets[s]
+                                                   : offsets[s + 1] - offsets[s]);
+    }
 
+    GLuint replacement;
+    mp_context->glGenBuffers(1, &replacement);
+    mp_context->glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, replacement);
+    mp_context->glBufferData(GL_COPY_WRITE_BUFFER, spliced[16] * vertexSize, nullptr, GL_STATIC_DRAW);
+    // One copy or upload per run of sections that are all kept or all replaced
+    for (int s = 0; s < 16; ) {
+        int end = s + 1;
+        while (end < 16 && replaced(end) == replaced(s)) {
+            ++end;
+        }
+        GLsizeiptr count = spliced[end] - spliced[s];
+        if (count > 0 && replaced(s)) {
+            mp_context->glBufferSubData(GL_COPY_WRITE_BUFFER, spliced[s] * vertexSize, count * vertexSize,
+                                        verts.data() + vertOffsets[s]);
+        } else if (count > 0) {
+            mp_context->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                            offsets[s] * vertexSize, spliced[s] * vertexSize,
+                                            count * vertexSize);
+        }
+        s = end;
+    }
+    mp_context->glDeleteBuffers(1, &buffer);
+    buffer = replacement;
+    offsets = spliced;
 }
@@ -4,7 +4,11 @@
 #include <array>
 #include <unordered_map>
 #include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <QReadWriteLock>
 #include "src/drawable.h"
+#include "palettedstorage.h"
 
 
 //using namespace std;
@@ -18,12 +22,47 @@ enum BlockType : unsigned char
     EMPTY, GRASS, DIRT, STONE, SNOW, LAVA, WATER, ICE, SAND, EMERALD, GOLD, SAPPHIRE
 };
 
+// The set of BlockTypes a bulk fill is allowed to overwrite,
+// e.g. BlockFilter::only(STONE) or BlockFilter::except(LAVA)
+class BlockFilter {
+private:
+    std::array<uint64_t, 4> m_bits;
+
+    constexpr BlockFilter(uint64_t fill) : m_bits{fill, fill, fill, fill} {}
+
+public:
+    static constexpr BlockFilter any() {
+        return BlockFilter(~uint64_t(0));
+    }
+    static constexpr BlockFilter only(BlockType t) {
+        BlockFilter f(0);
+        f.m_bits[t >> 6] |= uint64_t(1) << (t & 63);
+        return f;
+    }
+    static constexpr BlockFilter except(BlockType t) {
+        BlockFilter f(~uint64_t(0));
+        f.m_bits[t >> 6] &= ~(uint64_t(1) << (t & 63));
+        return f;
+    }
+    constexpr bool accepts(BlockType t) const {
+        return (m_bits[t >> 6] >> (t & 63)) & 1;
+    }
+    constexpr bool acceptsAll() const {
+        return (m_bits[0] & m_bits[1] & m_bits[2] & m_bits[3]) == ~uint64_t(0);
+    }
+};
+
 // The six cardinal directions in 3D space
 enum Direction : unsigned char
 {
     XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
 };
 
+// The two directions of an axis differ only in their lowest bit
+inline Direction opposite(Direction dir) {
+    return static_cast<Direction>(dir ^ 1);
+}
+
 // Lets us use any enum class as the key of a
 // std::unordered_map
 struct EnumHash {
@@ -33,6 +72,41 @@ struct EnumHash {
     }
 };
 
+// One vertex of a Chunk's mesh, packed into 8 bytes and decoded by lambert.vert.glsl.
+// Positions are local to the Chunk; the shader adds the Chunk's origin back.
+//   pos: x (5 bits) | y (9 bits) << 5 | z (5 bits) << 14 | face Direction (3 bits) << 19
+//   tex: atlas tile (8 bits, column + 16 * row) | quad corner (2 bits) << 8 | anim (1 bit) << 10
+struct ChunkVertex {
+    GLuint pos;
+    GLuint tex;
+};
+static_assert(sizeof(ChunkVertex) == 8, "ChunkVertex must stay 8 bytes");
+
+// Where a Chunk is in the pipeline that generates, meshes and uploads it.
+// Every transition is atomic, so any thread can check the state.
+enum class ChunkState : unsigned char
+{
+    ALLOCATED,     // Created, no blocks written yet
+    GENERATING,    // A BlockTypeWorker is writing its blocks
+    BLOCKS_READY,  // Blocks complete, not meshed yet
+    MESHING,       // A VBOWorker is meshing it
+    MESH_READY,    // The mesh is built and waits for upload on the GL thread
+    UPLOADED,      // The GPU holds its current mesh
+    DIRTY          // Its blocks changed since the last mesh, which has to be made again
+};
+
+// The vectors Chunk::createVBO writes into
+struct MeshTarget;
+// The padded copy of a Chunk and its borders that one mesh job reads
+struct MeshSnapshot;
+
+// Where the quads of each of a Chunk's 16 sections start in its opaque and
+// transparent VBOs, counted in vertices: section s spans [opq[s], opq[s + 1])
+struct SectionOffsets {
+    std::array<unsigned int, 17> opq;
+    std::array<unsigned int, 17> tran;
+};
+
 // One Chunk is a 16 x 256 x 16 section of the world,
 // containing all the Minecraft blocks in that area.
 // We divide the world into Chunks in order to make
@@ -43,43 +117,216 @@ struct EnumHash {
 // TODO have Chunk inherit from Drawable
 class Chunk : public Drawable {
 private:
-    // All of the blocks contained within this Chunk
-    std::array<BlockType, 65536> m_blocks;
-    // This Chunk's four neighbors to the north, south, east, and west
-    // The third input to this map just lets us use a Direction as
-    // a key for this map.
-    // These allow us to properly determine
-    std::unordered_map<Direction, Chunk*, EnumHash> m_neighbors;
+    // All of the blocks contained within this Chunk, as 16 vertical sections
+    // of 16 x 16 x 16 blocks, each palette-compressed. A section holding a
+    // single block type (e.g. all air) stores no per-block data at all.
+    // Writes can repack a section, so every access holds m_blocksLock.
+    std::vector<PalettedStorage> m_sections;
+    mutable QReadWriteLock m_blocksLock;
+    // Per column (x + 16 * z): the y of the highest non-EMPTY block, or -1
+    // if there is none, and the y of the lowest block that does not hide the
+    // faces next to it (see BlockRegistry::isOpaque), or 256 if there is none.
+    // setBlockAt keeps both up to date; they are guarded by m_blocksLock.
+    std::array<short, 256> m_highestBlock;
+    std::array<short, 256> m_lowestExposed;
+    // Where each section's quads are in the uploaded VBOs (GL thread only)
+    SectionOffsets m_sectionOffsets;
+    // This Chunk's four neighbors to the north, south, east, and west,
+    // indexed by Direction (YPOS and YNEG stay null). They are linked
+    // while other threads mesh, hence atomic.
+    std::array<std::atomic<Chunk*>, 6> m_neighbors;
 
     int worldP_x;
     int worldP_z;
 
+    // Terrain::draw's frame counter when the Chunk was last drawn, which
+    // Terrain::unloadChunks uses to pick the least recently used zones
+    std::atomic<unsigned int> m_lastUsed;
+    // Set once the Chunk has been unloaded. Work still queued for it is dropped.
+    std::atomic_bool m_retired;
+    // The player changed a block, so the Chunk cannot be regenerated from noise
+    std::atomic_bool m_edited;
+    // The ChunkState in the low byte and above it the generation, which
+    // counts the meshes requested for this Chunk; only beginMeshing bumps it.
+    // A mesh job carries the generation it was started with, and its result
+    // is thrown away if another mesh job was started in the meantime. A
+    // Chunk that became DIRTY while it was meshed keeps its generation: the
+    // mesh is still uploaded, and the Chunk stays DIRTY so it is meshed again.
+    // Both live in one word so that every transition is a single CAS.
+    std::atomic<uint64_t> m_lifecycle;
+    // Bit dir is set if the last mesh was made without a ready neighbor
+    // across dir, so the mesh has to be made again once that neighbor is ready
+    mutable std::atomic<unsigned char> m_missingNeighbors;
+    // Bit s is set if section s changed since the mesh job that last took the bits
+    std::atomic<uint16_t> m_dirtySections;
+    // The level of detail the next mesh job meshes at
+    std::atomic<unsigned char> m_levelOfDetail;
+
+    // Runtime switch between the per-face and the greedy mesher
+    static std::atomic_bool s_greedyMeshing;
+
+    // Brings the column maps up to date after t was written at (x, y, z)
+    void updateColumnMaps(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+    // The same after every block of the column in [yMin, yMax) became t
+    void updateColumnMaps(int x, int z, int yMin, int yMax, BlockType t);
+    // Recomputes both column maps from the blocks, e.g. after restoreSections
+    void rebuildColumnMaps();
+    // Every block of the section hides the faces touching it. m_blocksLock must be held.
+    bool isSectionOpaqueLocked(int section) const;
+    // Drops the unused palette values of sections [first, last], so a
+    // section left with one block type stores no per-block data and is
+    // seen as uniform. m_blocksLock must be held for writing.
+    void compactSectionsLocked(int first, int last);
+    // Copies everything meshing reads, from this Chunk and the borders of
+    // its neighbors, locking one Chunk at a time
+    void takeSnapshot(MeshSnapshot *snapshot) const;
+    void meshSection(const MeshTarget &target, const MeshSnapshot &snapshot, int section);
+    void createGreedySection(const MeshTarget &target, const MeshSnapshot &snapshot, int section);
+    // Uploads verts into a new buffer that then replaces buffer
+    void replaceBuffer(GLuint &buffer, bool &generated, const std::vector<ChunkVertex> &verts);
+    // Replaces the sections in sectionMask of buffer, laid out by offsets,
+    // with their vertices in verts, laid out by vertOffsets. The result is
+    // built in a new buffer that then replaces buffer; the other sections'
+    // vertices are copied over on the GPU rather than meshed again.
+    void spliceSections(GLuint &buffer, std::array<unsigned int, 17> &offsets,
+                        uint16_t sectionMask, const std::vector<ChunkVertex> &verts,
+                        const std::array<unsigned int, 17> &vertOffsets);
+
 public:
     //Chunk();
     Chunk(OpenGLContext*);
     void virtual create();
 
-    void createVBO(
-            std::vector<glm::vec4>* posOpq,
-            std::vector<glm::vec4>* norOpq,
-            std::vector<glm::vec2>* uvOpq,
-            std::vector<float> *animOpq,
-            std::vector<GLuint>* idxOpq,
-            std::vector<glm::vec4> *posTran,
-            std::vector<glm::vec4> *norTran,
-            std::vector<glm::vec2> *uvTran,
-            std::vector<float> *animTran,
-            std::vector<GLuint>* idxTran);
-    void sendToGPU(std::vector<float>* allOpq,
-                   std::vector<GLuint>* idxOpq,
-                   std::vector<float>* allTran,
-                   std::vector<GLuint>* idxTran);
+    // A section mask naming all 16 sections
+    static const uint16_t ALL_SECTIONS = 0xffff;
+
+    // The coarsest level of detail. At level l, every cube of 2^l blocks
+    // on a side is meshed as one block.
+    static constexpr int MAX_LEVEL_OF_DETAIL = 3;
+
+    // Meshes are lists of quads, four vertices each; they are drawn with
+    // the indices of the QuadIndexBuffer shared by every Chunk. The quads
+    // are grouped by section, as recorded in sections. Only the sections
+    // in sectionMask are meshed; the others are left empty.
+    void createVBO(std::vector<ChunkVertex>* vertOpq,
+                   std::vector<ChunkVertex>* vertTran,
+                   SectionOffsets* sections,
+                   uint16_t sectionMask = ALL_SECTIONS,
+                   int levelOfDetail = 0);
+    // Uploads a mesh made by createVBO with the same sectionMask. A whole
+    // mesh replaces the VBOs; a partial one is spliced into them. Either
+    // way the new VBOs are filled before they replace the old ones, so the
+    // old mesh is drawn until then.
+    void sendToGPU(std::vector<ChunkVertex>* vertOpq,
+                   std::vector<ChunkVertex>* vertTran,
+                   const SectionOffsets &sections,
+                   uint16_t sectionMask = ALL_SECTIONS);
     virtual ~Chunk();
     GLenum virtual drawMode();
     void setWorldPos(int x, int z);
+    // World position the Chunk's packed vertex positions are relative to
+    glm::ivec3 meshOrigin() const;
+    // World position of the Chunk's lower-left corner
+    glm::ivec2 worldPos() const;
+
+    // When enabled, createVBO merges coplanar faces of the same block
+    // type into larger quads instead of emitting one quad per face
+    static void setGreedyMeshing(bool enabled);
+    static bool greedyMeshing();
+    // The level of detail the Chunk is meshed at from now on, 0 for full
+    // detail. Set on the main thread, which also queues the new mesh.
+    void setLevelOfDetail(int level);
+    int levelOfDetail() const;
 
-    void linkNeighbor(uPtr<Chunk>& neighbor, Direction dir);
+    // Links this Chunk and neighbor, which may be null, to each other
+    void linkNeighbor(Chunk *neighbor, Direction dir);
+    // Clears the links between this Chunk and its neighbors
+    void unlinkNeighbors();
+
+    void touch(unsigned int frame);
+    unsigned int lastUsed() const;
+    void retire();
+    bool isRetired() const;
+    void markEdited();
+    bool isEdited() const;
+
+    ChunkState state() const;
+    // ALLOCATED -> GENERATING, when a BlockTypeWorker takes the Chunk
+    void beginGenerating();
+    // -> BLOCKS_READY once its blocks are written. Generation writes
+    // column by column, so this first compacts every section's palette:
+    // stone sections that held air when they were created drop to 0 bits.
+    void markBlocksReady();
+    // Generation has finished writing the Chunk's blocks, so they can be
+    // read, drawn and collided with. Meshes only read the borders of
+    // neighbors whose blocks are ready.
+    bool blocksReady() const;
+    uint64_t generation() const;
+    // -> MESHING, before a mesh job is started. Returns the generation the
+    // job has to hand to finishMeshing and markUploaded.
+    uint64_t beginMeshing();
+    // MESHING -> MESH_READY, unless the Chunk became DIRTY while it was meshed
+    void finishMeshing(uint64_t generation);
+    // MESH_READY -> UPLOADED on the GL thread. Returns false if a newer mesh
+    // was requested since this generation's, which makes it stale: it must
+    // not be uploaded. A DIRTY Chunk's mesh is still uploaded, as it is
+    // newer than the one on the GPU, but the Chunk stays DIRTY.
+    bool markUploaded(uint64_t generation);
+    // The given sections changed after the Chunk was meshed (or while it
+    // was): -> DIRTY, keeping the generation. The caller queues the Chunk
+    // to be meshed again.
+    void markDirty(uint16_t sections = ALL_SECTIONS);
+    // The sections the next mesh job meshes: the dirty ones if the GPU holds
+    // a mesh to splice them into, otherwise all. Clears the dirty sections.
+    // GL thread only.
+    uint16_t takeSectionsToMesh();
+    // Was the last mesh made without a ready neighbor across dir?
+    bool meshedWithout(Direction dir) const;
+    // The neighbor across dir, or nullptr
+    Chunk* neighbor(Direction dir) const;
     BlockType getBlockAt(unsigned int x, unsigned int y, unsigned int z) const;
     BlockType getBlockAt(int x, int y, int z) const;
     void setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+    // Like getBlockAt and setBlockAt without the bounds check and without
+    // the lock, for callers that already know x and z are in [0, 16) and y
+    // is in [0, 256) and that hold the lock below (see BlockCursor)
+    BlockType getBlockUnchecked(unsigned int x, unsigned int y, unsigned int z) const;
+    void setBlockUnchecked(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+    // Locks the blocks for a run of *Unchecked accesses. Every other method
+    // takes the lock itself, so none may be called on the Chunk until
+    // unlockBlocks.
+    void lockBlocksForReading() const;
+    void lockBlocksForWriting();
+    void unlockBlocks() const;
+    // Writes t to every block of the local box [lo, hi) that the filter
+    // accepts, under a single lock. Sections the box covers completely are
+    // refilled outright. Once the Chunk's blocks are ready, the sections
+    // the box touched are compacted. The box must lie within the Chunk.
+    void fillBox(glm::ivec3 lo, glm::ivec3 hi, BlockType t,
+                 const BlockFilter &filter = BlockFilter::any());
+    // Writes all 65536 blocks to out, in getBlockAt's x + 16 * y + 16 * 256 * z order
+    void getBlocks(BlockType *out) const;
+    // Bytes used by this Chunk's block storage: the section objects and
+    // what they hold on the heap
+    size_t blockMemoryUsage() const;
+    // The same for sections taken out of a Chunk by copySections
+    static size_t sectionsMemoryUsage(const std::vector<PalettedStorage> &sections);
+    // Bytes this Chunk holds in total: the object, its blocks and its VBOs
+    size_t memoryUsage() const;
+    // A copy of the block sections, to be handed back to restoreSections
+    // on a Chunk regenerated at the same position
+    std::vector<PalettedStorage> copySections() const;
+    void restoreSections(std::vector<PalettedStorage> sections);
+    // The section holds nothing but EMPTY blocks
+    bool isSectionEmpty(int section) const;
+    // y of the highest non-EMPTY block in the column, or -1 if it is empty
+    int getHighestBlockAt(int x, int z) const;
+    // y of the lowest non-opaque block in the column, or 256 if there is none.
+    // Every block below it is opaque, so only it and the blocks above it
+    // can show faces to this column.
+    int getLowestExposedAt(int x, int z) const;
 };
+
+inline BlockType Chunk::getBlockUnchecked(unsigned int x, unsigned int y, unsigned int z) const {
+    return static_cast<BlockType>(m_sections[y >> 4].get(x + 16 * (y & 15) + 16 * 16 * z));
+}
@@ -0,0 +1,53 @@
+#include "chunkgrid.h"
+#include "terrain.h"
+
+ChunkGrid::ChunkGrid(int sizeLog2)
+    : m_sizeLog2(sizeLog2), m_mask((1 << sizeLog2) - 1),
+      m_minX(-(1 << sizeLog2) / 2), m_minZ(-(1 << sizeLog2) / 2),
+      m_slots(size_t(1) << (2 * sizeLog2))
+{
+    for (std::atomic<Chunk*> &slot : m_slots) {
+        slot = nullptr;
+    }
+}
+
+bool ChunkGrid::contains(int x, int z) const {
+    int chunkX = (x >> 4) - m_minX;
+    int chunkZ = (z >> 4) - m_minZ;
+    return chunkX >= 0 && chunkX <= m_mask && chunkZ >= 0 && chunkZ <= m_mask;
+}
+
+void ChunkGrid::place(Chunk *c) {
+    glm::ivec2 pos = c->worldPos();
+    if (contains(pos.x, pos.y)) {
+        m_slots[slotOf(pos.x >> 4, pos.y >> 4)].store(c, std::memory_order_release);
+    }
+}
+
+void ChunkGrid::remove(Chunk *c) {
+    glm::ivec2 pos = c->worldPos();
+    m_slots[slotOf(pos.x >> 4, pos.y >> 4)].compare_exchange_strong(c, nullptr);
+}
+
+void ChunkGrid::recenter(int x, int z, const ChunkMap &map) {
+    int half = (m_mask + 1) / 2;
+    int minX = (x >> 4) - half;
+    int minZ = (z >> 4) - half;
+    if (minX == m_minX && minZ == m_minZ) {
+        return;
+    }
+    m_minX = minX;
+    m_minZ = minZ;
+    // Every slot now stands for the one Chunk of the window that maps to it
+    for (int i = 0; i <= m_mask; ++i) {
+        int chunkX = minX + ((i - minX) & m_mask);
+        for (int j = 0; j <= m_mask; ++j) {
+            int chunkZ = minZ + ((j - minZ) & m_mask);
+            std::atomic<Chunk*> &slot = m_slots[slotOf(chunkX, chunkZ)];
+            Chunk *c = slot.load(std::memory_order_relaxed);
+            if (c == nullptr || c->worldPos() != glm::ivec2(16 * chunkX, 16 * chunkZ)) {
+                slot.store(map.find(toKey(16 * chunkX, 16 * chunkZ)), std::memory_order_release);
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "chunk.h"
+#include "chunkmap.h"
+
+// A square window of Chunk slots around the player, (1 << sizeLog2) Chunks
+// on a side. A Chunk's slot is picked by the low bits of its Chunk
+// coordinates, so the window wraps around like a torus: moving it only
+// refills the rows and columns that scrolled in, and a lookup is a shift,
+// a mask and a compare instead of a hash.
+// Chunks outside the window are only found through the Terrain's ChunkMap.
+// find() is lock-free and may be called from any thread; place(), remove()
+// and recenter() are only called from the main thread.
+class ChunkGrid
+{
+public:
+    explicit ChunkGrid(int sizeLog2);
+
+    // The Chunk containing these world-space coordinates if its slot holds
+    // it, otherwise nullptr (the Chunk may still exist outside the window)
+    Chunk* find(int x, int z) const;
+    // Puts c into its slot if it lies within the window
+    void place(Chunk *c);
+    // Empties c's slot if it holds c
+    void remove(Chunk *c);
+    // Centers the window on the Chunk containing these world-space
+    // coordinates, filling the slots that scrolled in from map
+    void recenter(int x, int z, const ChunkMap &map);
+    // Do these world-space coordinates lie within the window?
+    bool contains(int x, int z) const;
+    // The smallest sizeLog2 whose window, centered on some Chunk, holds
+    // every Chunk within reach Chunks of it in x and z
+    static constexpr int sizeLog2For(int reach) {
+        int sizeLog2 = 0;
+        // recenter() puts half the window below the center Chunk and the
+        // center and the rest above it
+        while ((1 << sizeLog2) / 2 < reach + 1) {
+            ++sizeLog2;
+        }
+        return sizeLog2;
+    }
+
+private:
+    const int m_sizeLog2;
+    const int m_mask;
+    // Chunk coordinates (world coordinates / 16) of the window's lower-left slot
+    std::atomic<int> m_minX;
+    std::atomic<int> m_minZ;
+    std::vector<std::atomic<Chunk*>> m_slots;
+
+    size_t slotOf(int chunkX, int chunkZ) const;
+};
+
+inline size_t ChunkGrid::slotOf(int chunkX, int chunkZ) const {
+    return (chunkX & m_mask) | (chunkZ & m_mask) << m_sizeLog2;
+}
+
+inline Chunk* ChunkGrid::find(int x, int z) const {
+    Chunk *c = m_slots[slotOf(x >> 4, z >> 4)].load(std::memory_order_acquire);
+    // The slot may hold another Chunk that maps to it, or none
+    if (c != nullptr && c->worldPos() == glm::ivec2(x & ~15, z & ~15)) {
+        return c;
+    }
+    return nullptr;
+}
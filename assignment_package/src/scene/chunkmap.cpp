@@ -0,0 +1,61 @@
+#include "chunkmap.h"
+#include "terrain.h"
+
+ChunkMap::ChunkMap()
+    : m_shards(), m_insertMutex()
+{}
+
+// The low two bits of the Chunk's x and z index, i.e. bits 4 and 5 of each
+// coordinate, so a 4 x 4 block of Chunks spreads over all 16 shards
+size_t ChunkMap::shardOf(int64_t key) {
+    uint64_t k = static_cast<uint64_t>(key);
+    return ((k >> 36) & 3) | (((k >> 4) & 3) << 2);
+}
+
+Chunk* ChunkMap::find(int64_t key) const {
+    const Shard &shard = m_shards[shardOf(key)];
+    QReadLocker locker(&shard.lock);
+    auto it = shard.chunks.find(key);
+    return it != shard.chunks.end() ? it->second.get() : nullptr;
+}
+
+Chunk* ChunkMap::insert(int x, int z, uPtr<Chunk> chunk) {
+    // Held across the neighbor linking too, so two Chunks inserted side by
+    // side at the same time still end up linked to each other
+    QMutexLocker insertLocker(&m_insertMutex);
+    int64_t key = toKey(x, z);
+    Chunk *stored = find(key);
+    if (stored != nullptr) {
+        return stored;
+    }
+    stored = chunk.get();
+    {
+        Shard &shard = m_shards[shardOf(key)];
+        QWriteLocker locker(&shard.lock);
+        shard.chunks[key] = std::move(chunk);
+    }
+
+    stored->linkNeighbor(find(toKey(x, z + 16)), ZPOS);
+    stored->linkNeighbor(find(toKey(x, z - 16)), ZNEG);
+    stored->linkNeighbor(find(toKey(x + 16, z)), XPOS);
+    stored->linkNeighbor(find(toKey(x - 16, z)), XNEG);
+    return stored;
+}
+
+uPtr<Chunk> ChunkMap::remove(int64_t key) {
+    // Serialized with insert so a Chunk is never linked to one being removed
+    QMutexLocker insertLocker(&m_insertMutex);
+    uPtr<Chunk> removed;
+    {
+        Shard &shard = m_shards[shardOf(key)];
+        QWriteLocker locker(&shard.lock);
+        auto it = shard.chunks.find(key);
+        if (it == shard.chunks.end()) {
+            return nullptr;
+        }
+        removed = std::move(it->second);
+        shard.chunks.erase(it);
+    }
+    removed->unlinkNeighbors();
+    return removed;
+}
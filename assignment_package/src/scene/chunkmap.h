@@ -0,0 +1,59 @@
+#pragma once
+#include <QMutex>
+#include <QReadWriteLock>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include "src/smartpointerhelp.h"
+#include "chunk.h"
+
+// Owns every Chunk of the Terrain, keyed by toKey() of its lower-left corner.
+// The keys are split over shards, each behind its own read-write lock, so
+// lookups from worker threads only ever wait for an insert into the same
+// shard and never for each other. Inserts are serialized.
+// A Chunk is never moved once stored, so the Chunk* handed out stay valid
+// for as long as the map holds the Chunk and can be used without any lock.
+// Removed Chunks are handed back to the caller, who decides when the last
+// thread using them is done.
+class ChunkMap
+{
+public:
+    ChunkMap();
+
+    // The Chunk stored under key, or nullptr
+    Chunk* find(int64_t key) const;
+    // Stores chunk, whose lower-left corner is (x, z), and links it with the
+    // neighbors already stored. Returns the stored Chunk, which is the one
+    // that was there before if another thread inserted it first.
+    Chunk* insert(int x, int z, uPtr<Chunk> chunk);
+    // Takes the Chunk stored under key out of the map and unlinks it from
+    // its neighbors. Returns nullptr if there is none.
+    uPtr<Chunk> remove(int64_t key);
+    // Calls f(Chunk*) for every stored Chunk, one shard at a time
+    template <class F>
+    void forEach(F f) const;
+
+private:
+    // Adjacent Chunks land in different shards
+    static const int SHARD_BITS = 4;
+
+    struct Shard {
+        mutable QReadWriteLock lock;
+        std::unordered_map<int64_t, uPtr<Chunk>> chunks;
+    };
+
+    std::array<Shard, 1 << SHARD_BITS> m_shards;
+    QMutex m_insertMutex;
+
+    static size_t shardOf(int64_t key);
+};
+
+template <class F>
+void ChunkMap::forEach(F f) const {
+    for (const Shard &shard : m_shards) {
+        QReadLocker locker(&shard.lock);
+        for (const auto &kv : shard.chunks) {
+            f(kv.second.get());
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// One bit per block of a 256 block tall column: bit y is bit y % 64 of word y / 64.
+// The operations below work on all 256 bits at once, with AVX2 or SSE2 when
+// the compiler targets them and with plain 64-bit words otherwise.
+struct alignas(32) ColumnMask {
+    uint64_t words[4];
+
+    void set(int y) {
+        words[y >> 6] |= uint64_t(1) << (y & 63);
+    }
+    bool test(int y) const {
+        return (words[y >> 6] >> (y & 63)) & 1;
+    }
+    // The 16 bits of section s, bit i for y = 16 * s + i
+    uint16_t section(int s) const {
+        return uint16_t(words[s >> 2] >> (16 * (s & 3)));
+    }
+};
+
+// Bits set in a but not in b
+inline ColumnMask andNot(const ColumnMask &a, const ColumnMask &b) {
+    ColumnMask r;
+#if defined(__AVX2__)
+    __m256i va = _mm256_load_si256(reinterpret_cast<const __m256i*>(a.words));
+    __m256i vb = _mm256_load_si256(reinterpret_cast<const __m256i*>(b.words));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(r.words), _mm256_andnot_si256(vb, va));
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (int i = 0; i < 4; i += 2) {
+        __m128i va = _mm_load_si128(reinterpret_cast<const __m128i*>(a.words + i));
+        __m128i vb = _mm_load_si128(reinterpret_cast<const __m128i*>(b.words + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(r.words + i), _mm_andnot_si128(vb, va));
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        r.words[i] = a.words[i] & ~b.words[i];
+    }
+#endif
+    return r;
+}
+
+// Bit y of the result is bit y + 1 of m, i.e. it tells about the block
+// above; above the top of the column reads as 0
+inline ColumnMask shiftedDown(const ColumnMask &m) {
+    ColumnMask r;
+#if defined(__AVX2__)
+    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(m.words));
+    // The bit carried from the bottom of each word into the top of the one below
+    __m256i carry = _mm256_permute4x64_epi64(_mm256_slli_epi64(v, 63), _MM_SHUFFLE(3, 3, 2, 1));
+    carry = _mm256_blend_epi32(carry, _mm256_setzero_si256(), 0xc0);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(r.words), _mm256_or_si256(_mm256_srli_epi64(v, 1), carry));
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(m.words));
+    __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(m.words + 2));
+    __m128i carryLo = _mm_or_si128(_mm_slli_epi64(_mm_srli_si128(lo, 8), 63),
+                                   _mm_slli_epi64(_mm_slli_si128(hi, 8), 63));
+    __m128i carryHi = _mm_slli_epi64(_mm_srli_si128(hi, 8), 63);
+    _mm_store_si128(reinterpret_cast<__m128i*>(r.words), _mm_or_si128(_mm_srli_epi64(lo, 1), carryLo));
+    _mm_store_si128(reinterpret_cast<__m128i*>(r.words + 2), _mm_or_si128(_mm_srli_epi64(hi, 1), carryHi));
+#else
+    for (int i = 0; i < 4; ++i) {
+        r.words[i] = m.words[i] >> 1 | (i < 3 ? m.words[i + 1] << 63 : 0);
+    }
+#endif
+    return r;
+}
+
+// Bit y of the result is bit y - 1 of m, i.e. it tells about the block
+// below; below the bottom of the column reads as 0
+inline ColumnMask shiftedUp(const ColumnMask &m) {
+    ColumnMask r;
+#if defined(__AVX2__)
+    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(m.words));
+    // The bit carried from the top of each word into the bottom of the one above
+    __m256i carry = _mm256_permute4x64_epi64(_mm256_srli_epi64(v, 63), _MM_SHUFFLE(2, 1, 0, 0));
+    carry = _mm256_blend_epi32(carry, _mm256_setzero_si256(), 0x03);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(r.words), _mm256_or_si256(_mm256_slli_epi64(v, 1), carry));
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(m.words));
+    __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(m.words + 2));
+    __m128i carryLo = _mm_srli_epi64(_mm_slli_si128(lo, 8), 63);
+    __m128i carryHi = _mm_or_si128(_mm_srli_epi64(_mm_slli_si128(hi, 8), 63),
+                                   _mm_srli_epi64(_mm_srli_si128(lo, 8), 63));
+    _mm_store_si128(reinterpret_cast<__m128i*>(r.words), _mm_or_si128(_mm_slli_epi64(lo, 1), carryLo));
+    _mm_store_si128(reinterpret_cast<__m128i*>(r.words + 2), _mm_or_si128(_mm_slli_epi64(hi, 1), carryHi));
+#else
+    for (int i = 0; i < 4; ++i) {
+        r.words[i] = m.words[i] << 1 | (i > 0 ? m.words[i - 1] >> 63 : 0);
+    }
+#endif
+    return r;
+}
+
+// Index of the lowest set bit of bits, which must not be 0
+inline int lowestBit(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bits);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return int(index);
+#else
+    int index = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
@@ -0,0 +1,215 @@
+#include "horizon.h"
+#include "terrain.h"
+#include "noisegrid.h"
+#include "src/horizonworker.h"
+#include <QThreadPool>
+#include <cmath>
+
+namespace {
+
+// Skirts hang down to here; every generated surface is above it
+const float SKIRT_BOTTOM = 128.f;
+
+glm::vec4 surfaceColor(BlockType t) {
+    switch (t) {
+    case GRASS:
+        return glm::vec4(0.37f, 0.6f, 0.22f, 1.f);
+    case SAND:
+        return glm::vec4(0.86f, 0.8f, 0.55f, 1.f);
+    case SNOW:
+        return glm::vec4(0.95f, 0.95f, 1.f, 1.f);
+    default:
+        return glm::vec4(0.5f, 0.5f, 0.5f, 1.f);
+    }
+}
+
+}
+
+HorizonTile::HorizonTile(OpenGLContext *context, HorizonTileData data)
+    : Drawable(context), m_data(std::move(data))
+{}
+
+HorizonTile::~HorizonTile() {
+    // Drawable::destroy only frees the interleaved Chunk buffers
+    if (m_idxGenerated) {
+        mp_context->glDeleteBuffers(1, &m_bufIdx);
+    }
+    if (m_posGenerated) {
+        mp_context->glDeleteBuffers(1, &m_bufPos);
+    }
+    if (m_norGenerated) {
+        mp_context->glDeleteBuffers(1, &m_bufNor);
+    }
+    if (m_colGenerated) {
+        mp_context->glDeleteBuffers(1, &m_bufCol);
+    }
+}
+
+void HorizonTile::create() {
+    m_count = int(m_data.idx.size());
+
+    generateIdx();
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_data.idx.size() * sizeof(GLuint), m_data.idx.data(), GL_STATIC_DRAW);
+    generatePos();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.pos.size() * sizeof(glm::vec4), m_data.pos.data(), GL_STATIC_DRAW);
+    generateNor();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufNor);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.nor.size() * sizeof(glm::vec4), m_data.nor.data(), GL_STATIC_DRAW);
+    generateCol();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufCol);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.col.size() * sizeof(glm::vec4), m_data.col.data(), GL_STATIC_DRAW);
+
+    m_data = HorizonTileData();
+}
+
+Horizon::Horizon(OpenGLContext *context, Terrain *terrain)
+    : mp_context(context), mp_terrain(terrain), m_tiles(), m_sampledTiles()
+{}
+
+int Horizon::levelOf(int ring) {
+    int level = 0;
+    while (level < MAX_LEVEL && ring > (1 << level)) {
+        ++level;
+    }
+    return level;
+}
+
+void Horizon::update(glm::vec3 position) {
+    int tileX = int(glm::floor(position.x / TILE_SIZE));
+    int tileZ = int(glm::floor(position.z / TILE_SIZE));
+    const int rings = RADIUS / TILE_SIZE;
+
+    for (int dx = -rings; dx <= rings; ++dx) {
+        for (int dz = -rings; dz <= rings; ++dz) {
+            int64_t key = toKey((tileX + dx) * TILE_SIZE, (tileZ + dz) * TILE_SIZE);
+            int level = levelOf(std::max(std::abs(dx), std::abs(dz)));
+            auto it = m_tiles.find(key);
+            if (it == m_tiles.end()) {
+                it = m_tiles.emplace(key, Tile{nullptr, -1, -1}).first;
+            }
+            if (it->second.requestedLevel != level) {
+                it->second.requestedLevel = level;
+                QThreadPool::globalInstance()->start(new HorizonWorker(mp_terrain, key, level, &m_sampledTiles));
+            }
+        }
+    }
+
+    // Tiles are dropped a ring past the radius, so walking along its edge
+    // does not sample the same tiles over and over
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        glm::ivec2 corner = toCoords(it->first) / TILE_SIZE;
+        if (std::max(std::abs(corner.x - tileX), std::abs(corner.y - tileZ)) > rings + 1) {
+            it = m_tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Until a tile's new level arrives, its old one keeps being drawn
+    for (HorizonTileData &data : m_sampledTiles.takeAll()) {
+        auto it = m_tiles.find(data.key);
+        if (it == m_tiles.end() || it->second.requestedLevel != data.level) {
+            continue;
+        }
+        int level = data.level;
+        uPtr<HorizonTile> tile = mkU<HorizonTile>(mp_context, std::move(data));
+        tile->create();
+        it->second.drawable = std::move(tile);
+        it->second.level = level;
+    }
+}
+
+void Horizon::draw(ShaderProgram *shaderProgram) {
+    for (auto &kv : m_tiles) {
+        if (kv.second.drawable) {
+            shaderProgram->draw(*kv.second.drawable);
+        }
+    }
+}
+
+HorizonTileData Horizon::sampleTile(Terrain *terrain, int64_t key, int level) {
+    HorizonTileData data;
+    data.key = key;
+    data.level = level;
+
+    glm::ivec2 corner = toCoords(key);
+    const int step = BASE_STEP << level;
+    const int n = TILE_SIZE / step;
+    // Surface heights of the tile's (n + 1)^2 vertices plus one sample
+    // past each edge, for the normals
+    const int side = n + 3;
+    // The noise fields ZoneGenerator blends its columns from, on a grid of
+    // one sample per step: sample k at scale / step is the block k * step
+    // at scale, and as step is a power of two both round the same, so the
+    // tile holds exactly the columns getColumnSurface gives
+    const int x0 = corner.x / step - 1;
+    const int z0 = corner.y / step - 1;
+    std::vector<float> mountain(side * side), worley(side * side), biome(side * side), sand(side * side);
+    NoiseGrid::perlin(x0, z0, side, side, 32.f / step, mountain.data());
+    NoiseGrid::perlin(x0, z0, side, side, 256.f / step, biome.data());
+    NoiseGrid::perlin(x0, z0, side, side, 200.f / step, sand.data());
+    NoiseGrid::worleyDistance(x0, z0, side, side, 64.f / step, worley.data());
+    std::vector<float> heights(side * side);
+    std::vector<BlockType> surfaces(side * side);
+    for (int i = 0; i < side * side; ++i) {
+        float w = std::abs(mountain[i]) * worley[i];
+        ColumnSurface column = terrain->blendColumn(terrain->mountainHeightOf(mountain[i]),
+                                                    terrain->grasslandHeightOf(w),
+                                                    terrain->sandHeightOf(w),
+                                                    biome[i], sand[i]);
+        heights[i] = float(column.top);
+        surfaces[i] = column.surface;
+    }
+    auto height = [&](int i, int j) {
+        return heights[(i + 1) + side * (j + 1)];
+    };
+
+    const int vertices = (n + 1) * (n + 1);
+    data.pos.reserve(vertices + 4 * (n + 1));
+    data.nor.reserve(vertices + 4 * (n + 1));
+    data.col.reserve(vertices + 4 * (n + 1));
+    data.idx.reserve(6 * n * n + 4 * 6 * n);
+    for (int j = 0; j <= n; ++j) {
+        for (int i = 0; i <= n; ++i) {
+            glm::vec3 normal = glm::normalize(glm::vec3(height(i - 1, j) - height(i + 1, j),
+                                                        2.f * step,
+                                                        height(i, j - 1) - height(i, j + 1)));
+            data.pos.push_back(glm::vec4(corner.x + i * step, height(i, j), corner.y + j * step, 1));
+            data.nor.push_back(glm::vec4(normal, 0));
+            data.col.push_back(surfaceColor(surfaces[(i + 1) + side * (j + 1)]));
+        }
+    }
+    auto index = [n](int i, int j) {
+        return GLuint(i + (n + 1) * j);
+    };
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+            GLuint a = index(i, j), b = index(i + 1, j), c = index(i + 1, j + 1), d = index(i, j + 1);
+            data.idx.insert(data.idx.end(), {a, b, c, a, c, d});
+        }
+    }
+
+    // One skirt per edge, walking its n + 1 vertices
+    const glm::ivec2 starts[4] = {glm::ivec2(0, 0), glm::ivec2(n, 0), glm::ivec2(n, n), glm::ivec2(0, n)};
+    const glm::ivec2 steps[4] = {glm::ivec2(1, 0), glm::ivec2(0, 1), glm::ivec2(-1, 0), glm::ivec2(0, -1)};
+    for (int edge = 0; edge < 4; ++edge) {
+        GLuint first = GLuint(data.pos.size());
+        for (int k = 0; k <= n; ++k) {
+            glm::ivec2 v = starts[edge] + k * steps[edge];
+            GLuint top = index(v.x, v.y);
+            glm::vec4 p = data.pos[top];
+            data.pos.push_back(glm::vec4(p.x, SKIRT_BOTTOM, p.z, 1));
+            data.nor.push_back(data.nor[top]);
+            data.col.push_back(data.col[top]);
+        }
+        for (int k = 0; k < n; ++k) {
+            glm::ivec2 v = starts[edge] + k * steps[edge];
+            glm::ivec2 w = v + steps[edge];
+            GLuint a = index(v.x, v.y), b = index(w.x, w.y), c = first + k + 1, d = first + k;
+            data.idx.insert(data.idx.end(), {a, b, c, a, c, d});
+        }
+    }
+    return data;
+}
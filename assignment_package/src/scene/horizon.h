@@ -0,0 +1,91 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "drawable.h"
+#include "src/smartpointerhelp.h"
+#include "src/glm_includes.h"
+#include "src/completionqueue.h"
+#include "src/shaderprogram.h"
+
+class Terrain;
+
+// The heightfield of one tile of far terrain, sampled every step blocks.
+// Built on a worker thread and uploaded on the GL thread.
+struct HorizonTileData {
+    int64_t key;
+    int level;
+    std::vector<glm::vec4> pos;
+    std::vector<glm::vec4> nor;
+    std::vector<glm::vec4> col;
+    std::vector<GLuint> idx;
+};
+
+// One uploaded tile of far terrain
+class HorizonTile : public Drawable
+{
+private:
+    HorizonTileData m_data;
+
+public:
+    HorizonTile(OpenGLContext *context, HorizonTileData data);
+    ~HorizonTile() override;
+    // Uploads the heightfield and frees it on the CPU side
+    void create() override;
+};
+
+// Far terrain past the Chunks: a heightfield of the same surface the
+// Chunks are generated with (Terrain::getColumnSurface, evaluated a whole
+// tile at a time with NoiseGrid), out to RADIUS blocks around the
+// player. The world is split into TILE_SIZE tiles, and
+// tiles farther away are sampled coarser, like a geomipmap: a tile at
+// level l is sampled every BASE_STEP << l blocks. Tiles are sampled on
+// worker threads and kept while they stay in range, so a tile is only
+// sampled again when its level changes. Cracks between tiles of different
+// levels are hidden by skirts that hang down from each tile's edges.
+// No Chunk is ever generated for it.
+class Horizon
+{
+public:
+    static constexpr int TILE_SIZE = 512;
+    static const int BASE_STEP = 8;
+    static const int MAX_LEVEL = 3;
+    // sampleTile relies on every step being a power of two
+    static_assert((BASE_STEP & (BASE_STEP - 1)) == 0, "Sample steps must be powers of two");
+    // Blocks from the player's tile to the farthest tile drawn
+    static const int RADIUS = 4096;
+    // Clip planes the horizon is drawn with. It is drawn before the
+    // Chunks and never in front of them, so it gets its own depth range.
+    static constexpr float NEAR_CLIP = 16.f;
+    static constexpr float FAR_CLIP = 6144.f;
+
+    Horizon(OpenGLContext *context, Terrain *terrain);
+
+    // Called every tick on the GL thread. Queues the tiles around the player
+    // that are missing or sampled at the wrong level, uploads the finished
+    // ones and drops the tiles that left the radius.
+    void update(glm::vec3 position);
+    // Draws every uploaded tile. The shader leaves out the box the Chunks
+    // are drawn in.
+    void draw(ShaderProgram *shaderProgram);
+
+    // Samples the tile whose lower-left corner is toCoords(key) every
+    // BASE_STEP << level blocks (called on worker threads)
+    static HorizonTileData sampleTile(Terrain *terrain, int64_t key, int level);
+
+private:
+    struct Tile {
+        uPtr<HorizonTile> drawable;
+        // Level of the uploaded drawable, -1 if there is none yet
+        int level;
+        // Level last queued; results of any other level are stale
+        int requestedLevel;
+    };
+
+    OpenGLContext *mp_context;
+    Terrain *mp_terrain;
+    std::unordered_map<int64_t, Tile> m_tiles;
+    CompletionQueue<HorizonTileData> m_sampledTiles;
+
+    // Level of a tile ring tiles away from the player's tile
+    static int levelOf(int ring);
+};
@@ -0,0 +1,347 @@
+#include "noisegrid.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NOISE_GRID_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit SSE2 and AVX instructions in functions marked for
+// them; MSVC emits them anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define NOISE_GRID_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NOISE_GRID_TARGET(isa)
+#endif
+
+glm::vec2 random2(glm::vec2 p) {
+    return glm::fract(glm::sin(glm::vec2(glm::dot(p, glm::vec2(127.1, 311.7)),
+                          glm::dot(p, glm::vec2(269.5, 183.3)))) * 43758.5453f);
+}
+
+namespace {
+
+// One row of perlin samples. Per column: its x and the x of its cell's
+// lower corner, and the gradients of the cell's four corners, in the order
+// (0, 0), (0, 1), (1, 0), (1, 1). The row's z and its cell's lower z are
+// the same for every column.
+struct PerlinRow {
+    const float *ux;
+    const float *cx;
+    float uz;
+    float cz;
+    const float *gx[4];
+    const float *gz[4];
+};
+
+// One row of worley distances. Per column: the fractional part of its x,
+// and the feature points of the nine cells around its own, neighbor (i, j)
+// at 3 * (i + 1) + (j + 1). The fractional part of the row's z is the same
+// for every column.
+struct WorleyRow {
+    const float *fx;
+    float fz;
+    const float *px[9];
+    const float *pz[9];
+};
+
+// 1 - (6 t^5 - 15 t^4 + 10 t^3), which Terrain::surflet computes with pow
+inline float falloff(float t) {
+    return 1.f - t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+void perlinRowScalar(const PerlinRow &r, int begin, int width, float *out) {
+    for (int i = begin; i < width; ++i) {
+        float sum = 0.f;
+        for (int k = 0; k < 4; ++k) {
+            float px = r.ux[i] - (r.cx[i] + float(k >> 1));
+            float pz = r.uz - (r.cz + float(k & 1));
+            float h = px * r.gx[k][i] + pz * r.gz[k][i];
+            sum += h * falloff(std::abs(px)) * falloff(std::abs(pz));
+        }
+        out[i] = sum;
+    }
+}
+
+void worleyRowScalar(const WorleyRow &r, int begin, int width, float *out) {
+    for (int i = begin; i < width; ++i) {
+        float minDist = 1.f;
+        for (int n = 0; n < 9; ++n) {
+            float dx = (float(n / 3 - 1) + r.px[n][i]) - r.fx[i];
+            float dz = (float(n % 3 - 1) + r.pz[n][i]) - r.fz;
+            minDist = std::min(minDist, std::sqrt(dx * dx + dz * dz));
+        }
+        out[i] = minDist;
+    }
+}
+
+#if defined(NOISE_GRID_X86)
+
+// The vector kernels do the scalar kernels' operations in the same order,
+// so they round the same way. Each returns how many columns it did; the
+// scalar kernel does the rest.
+
+NOISE_GRID_TARGET("sse2")
+int perlinRowSSE2(const PerlinRow &r, int width, float *out) {
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 six = _mm_set1_ps(6.f);
+    const __m128 fifteen = _mm_set1_ps(15.f);
+    const __m128 ten = _mm_set1_ps(10.f);
+    float pz[2], tz[2];
+    for (int dz = 0; dz < 2; ++dz) {
+        pz[dz] = r.uz - (r.cz + float(dz));
+        tz[dz] = falloff(std::abs(pz[dz]));
+    }
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128 ux = _mm_loadu_ps(r.ux + i);
+        __m128 cx = _mm_loadu_ps(r.cx + i);
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < 4; ++k) {
+            __m128 px = _mm_sub_ps(ux, _mm_add_ps(cx, _mm_set1_ps(float(k >> 1))));
+            __m128 t = _mm_andnot_ps(sign, px);
+            __m128 poly = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, six), fifteen)), ten);
+            __m128 tx = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), poly));
+            __m128 h = _mm_add_ps(_mm_mul_ps(px, _mm_loadu_ps(r.gx[k] + i)),
+                                  _mm_mul_ps(_mm_set1_ps(pz[k & 1]), _mm_loadu_ps(r.gz[k] + i)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(h, tx), _mm_set1_ps(tz[k & 1])));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+    return i;
+}
+
+NOISE_GRID_TARGET("sse2")
+int worleyRowSSE2(const WorleyRow &r, int width, float *out) {
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128 fx = _mm_loadu_ps(r.fx + i);
+        __m128 minDist = _mm_set1_ps(1.f);
+        for (int n = 0; n < 9; ++n) {
+            __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(n / 3 - 1)), _mm_loadu_ps(r.px[n] + i)), fx);
+            __m128 dz = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(n % 3 - 1)), _mm_loadu_ps(r.pz[n] + i)),
+                                   _mm_set1_ps(r.fz));
+            __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+            minDist = _mm_min_ps(dist, minDist);
+        }
+        _mm_storeu_ps(out + i, minDist);
+    }
+    return i;
+}
+
+NOISE_GRID_TARGET("avx")
+int perlinRowAVX(const PerlinRow &r, int width, float *out) {
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 six = _mm256_set1_ps(6.f);
+    const __m256 fifteen = _mm256_set1_ps(15.f);
+    const __m256 ten = _mm256_set1_ps(10.f);
+    float pz[2], tz[2];
+    for (int dz = 0; dz < 2; ++dz) {
+        pz[dz] = r.uz - (r.cz + float(dz));
+        tz[dz] = falloff(std::abs(pz[dz]));
+    }
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m256 ux = _mm256_loadu_ps(r.ux + i);
+        __m256 cx = _mm256_loadu_ps(r.cx + i);
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < 4; ++k) {
+            __m256 px = _mm256_sub_ps(ux, _mm256_add_ps(cx, _mm256_set1_ps(float(k >> 1))));
+            __m256 t = _mm256_andnot_ps(sign, px);
+            __m256 poly = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, six), fifteen)), ten);
+            __m256 tx = _mm256_sub_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), poly));
+            __m256 h = _mm256_add_ps(_mm256_mul_ps(px, _mm256_loadu_ps(r.gx[k] + i)),
+                                     _mm256_mul_ps(_mm256_set1_ps(pz[k & 1]), _mm256_loadu_ps(r.gz[k] + i)));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(h, tx), _mm256_set1_ps(tz[k & 1])));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+    return i;
+}
+
+NOISE_GRID_TARGET("avx")
+int worleyRowAVX(const WorleyRow &r, int width, float *out) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m256 fx = _mm256_loadu_ps(r.fx + i);
+        __m256 minDist = _mm256_set1_ps(1.f);
+        for (int n = 0; n < 9; ++n) {
+            __m256 dx = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(float(n / 3 - 1)), _mm256_loadu_ps(r.px[n] + i)), fx);
+            __m256 dz = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(float(n % 3 - 1)), _mm256_loadu_ps(r.pz[n] + i)),
+                                      _mm256_set1_ps(r.fz));
+            __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+            minDist = _mm256_min_ps(dist, minDist);
+        }
+        _mm256_storeu_ps(out + i, minDist);
+    }
+    return i;
+}
+
+#endif
+
+void perlinRow(NoiseGrid::Kernel kernel, const PerlinRow &r, int width, float *out) {
+    int done = 0;
+#if defined(NOISE_GRID_X86)
+    if (kernel == NoiseGrid::AVX) {
+        done = perlinRowAVX(r, width, out);
+    } else if (kernel == NoiseGrid::SSE2) {
+        done = perlinRowSSE2(r, width, out);
+    }
+#endif
+    perlinRowScalar(r, done, width, out);
+}
+
+void worleyRow(NoiseGrid::Kernel kernel, const WorleyRow &r, int width, float *out) {
+    int done = 0;
+#if defined(NOISE_GRID_X86)
+    if (kernel == NoiseGrid::AVX) {
+        done = worleyRowAVX(r, width, out);
+    } else if (kernel == NoiseGrid::SSE2) {
+        done = worleyRowSSE2(r, width, out);
+    }
+#endif
+    worleyRowScalar(r, done, width, out);
+}
+
+}
+
+bool NoiseGrid::supports(Kernel kernel) {
+    if (kernel == SCALAR) {
+        return true;
+    }
+#if defined(NOISE_GRID_X86) && (defined(__GNUC__) || defined(__clang__))
+    return kernel == AVX ? __builtin_cpu_supports("avx") : __builtin_cpu_supports("sse2");
+#elif defined(NOISE_GRID_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if (kernel == SSE2) {
+        return (info[3] >> 26) & 1;
+    }
+    // AVX, and an OS that saves the AVX registers
+    bool osxsave = (info[2] >> 27) & 1;
+    bool avx = (info[2] >> 28) & 1;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+    return false;
+#endif
+}
+
+NoiseGrid::Kernel NoiseGrid::bestKernel() {
+    static const Kernel best = supports(AVX) ? AVX : supports(SSE2) ? SSE2 : SCALAR;
+    return best;
+}
+
+void NoiseGrid::perlin(int x0, int z0, int width, int height, float scale, float *out, Kernel kernel) {
+    std::vector<float> ux(width), cx(width);
+    for (int i = 0; i < width; ++i) {
+        ux[i] = float(x0 + i) / scale;
+        cx[i] = std::floor(ux[i]);
+    }
+    // Gradients of every lattice point the grid touches
+    int cxMin = int(cx[0]);
+    int czMin = int(std::floor(float(z0) / scale));
+    int columns = int(cx[width - 1]) - cxMin + 2;
+    int rows = int(std::floor(float(z0 + height - 1) / scale)) - czMin + 2;
+    std::vector<glm::vec2> gradients(columns * rows);
+    for (int c = 0; c < columns; ++c) {
+        for (int r = 0; r < rows; ++r) {
+            gradients[c + columns * r] = random2(glm::vec2(cxMin + c, czMin + r)) * 2.f - glm::vec2(1, 1);
+        }
+    }
+
+    std::vector<float> corners(8 * width);
+    PerlinRow row;
+    row.ux = ux.data();
+    row.cx = cx.data();
+    for (int k = 0; k < 4; ++k) {
+        row.gx[k] = corners.data() + (2 * k) * width;
+        row.gz[k] = corners.data() + (2 * k + 1) * width;
+    }
+    int lastCz = INT_MIN;
+    for (int j = 0; j < height; ++j) {
+        row.uz = float(z0 + j) / scale;
+        row.cz = std::floor(row.uz);
+        // The corners only change when the row enters another cell
+        if (int(row.cz) != lastCz) {
+            lastCz = int(row.cz);
+            for (int k = 0; k < 4; ++k) {
+                float *gx = corners.data() + (2 * k) * width;
+                float *gz = corners.data() + (2 * k + 1) * width;
+                int r = lastCz - czMin + (k & 1);
+                for (int i = 0; i < width; ++i) {
+                    const glm::vec2 &g = gradients[int(cx[i]) - cxMin + (k >> 1) + columns * r];
+                    gx[i] = g.x;
+                    gz[i] = g.y;
+                }
+            }
+        }
+        perlinRow(kernel, row, width, out + width * j);
+    }
+}
+
+void NoiseGrid::worley(int x0, int z0, int width, int height, float scale, float *out, Kernel kernel) {
+    // worleyNoise doubles uv, and the perlin noise at twice uv is the one
+    // at half the scale: both round x / scale the same way
+    std::vector<float> perlinGrid(width * height);
+    perlin(x0, z0, width, height, scale / 2.f, perlinGrid.data(), kernel);
+    worleyDistance(x0, z0, width, height, scale, out, kernel);
+    for (int i = 0; i < width * height; ++i) {
+        out[i] = std::abs(perlinGrid[i]) * out[i];
+    }
+}
+
+void NoiseGrid::worleyDistance(int x0, int z0, int width, int height, float scale, float *out, Kernel kernel) {
+    std::vector<float> fx(width), cx(width);
+    for (int i = 0; i < width; ++i) {
+        float u = float(x0 + i) / scale * 2.f;
+        cx[i] = std::floor(u);
+        fx[i] = u - cx[i];
+    }
+    // Feature points of every cell the grid's neighborhoods touch
+    int cxMin = int(cx[0]) - 1;
+    int czMin = int(std::floor(float(z0) / scale * 2.f)) - 1;
+    int columns = int(cx[width - 1]) + 1 - cxMin + 1;
+    int rows = int(std::floor(float(z0 + height - 1) / scale * 2.f)) + 1 - czMin + 1;
+    std::vector<glm::vec2> points(columns * rows);
+    for (int c = 0; c < columns; ++c) {
+        for (int r = 0; r < rows; ++r) {
+            points[c + columns * r] = random2(glm::vec2(cxMin + c, czMin + r));
+        }
+    }
+
+    std::vector<float> neighbors(18 * width);
+    WorleyRow row;
+    row.fx = fx.data();
+    for (int n = 0; n < 9; ++n) {
+        row.px[n] = neighbors.data() + (2 * n) * width;
+        row.pz[n] = neighbors.data() + (2 * n + 1) * width;
+    }
+    int lastCz = INT_MIN;
+    for (int j = 0; j < height; ++j) {
+        float u = float(z0 + j) / scale * 2.f;
+        float cz = std::floor(u);
+        row.fz = u - cz;
+        if (int(cz) != lastCz) {
+            lastCz = int(cz);
+            for (int n = 0; n < 9; ++n) {
+                float *px = neighbors.data() + (2 * n) * width;
+                float *pz = neighbors.data() + (2 * n + 1) * width;
+                int r = lastCz + (n % 3 - 1) - czMin;
+                for (int i = 0; i < width; ++i) {
+                    const glm::vec2 &p = points[int(cx[i]) + (n / 3 - 1) - cxMin + columns * r];
+                    px[i] = p.x;
+                    pz[i] = p.y;
+                }
+            }
+        }
+        worleyRow(kernel, row, width, out + width * j);
+    }
+}
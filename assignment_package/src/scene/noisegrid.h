@@ -0,0 +1,36 @@
+#pragma once
+#include "src/glm_includes.h"
+
+// The hash the 2D noise functions give each lattice point, in [0, 1)^2
+glm::vec2 random2(glm::vec2 p);
+
+// Evaluates Terrain::perlinNoise and Terrain::worleyNoise over a whole grid
+// of columns in one call: out[i + width * j] is the noise at
+// ((x0 + i) / scale, (z0 + j) / scale).
+// Lattice points are hashed once per grid instead of several times per
+// sample, the quintic falloff is a polynomial instead of three pow calls,
+// and the per-sample math runs on SSE2 or AVX, whichever the CPU has
+// (checked at run time), with a scalar fallback. Every kernel rounds like
+// the single-point functions, so results match them exactly.
+class NoiseGrid
+{
+public:
+    enum Kernel {
+        SCALAR, SSE2, AVX
+    };
+
+    // Whether this CPU (and build) can run the kernel
+    static bool supports(Kernel kernel);
+    // The fastest supported kernel, picked on first use
+    static Kernel bestKernel();
+
+    static void perlin(int x0, int z0, int width, int height, float scale, float *out,
+                       Kernel kernel = bestKernel());
+    static void worley(int x0, int z0, int width, int height, float scale, float *out,
+                       Kernel kernel = bestKernel());
+    // The distance part of worley alone: worley at scale is the absolute
+    // perlin noise at scale / 2 times this, so a caller that already has
+    // that perlin grid need not compute it again
+    static void worleyDistance(int x0, int z0, int width, int height, float scale, float *out,
+                               Kernel kernel = bestKernel());
+};
@@ -0,0 +1,185 @@
+#include "palettedstorage.h"
+#include <algorithm>
+
+PalettedStorage::PalettedStorage(size_t size, unsigned char fillValue)
+    : m_size(size), m_bits(0), m_palette(), m_paletteIndex(), m_words()
+{
+    fill(fillValue);
+}
+
+void PalettedStorage::fill(unsigned char value) {
+    m_bits = 0;
+    m_palette.assign(1, value);
+    m_paletteIndex.clear();
+    m_paletteIndex.shrink_to_fit();
+    m_words.clear();
+    m_words.shrink_to_fit();
+}
+
+unsigned char PalettedStorage::indexOf(unsigned char value) {
+    size_t index;
+    if (m_paletteIndex.empty()) {
+        index = std::find(m_palette.begin(), m_palette.end(), value) - m_palette.begin();
+    } else {
+        index = m_paletteIndex[value];
+    }
+    if (index >= m_palette.size() || m_palette[index] != value) {
+        if (m_palette.size() == (size_t(1) << m_bits)) {
+            widen();
+        }
+        index = m_palette.size();
+        m_palette.push_back(value);
+        if (!m_paletteIndex.empty()) {
+            m_paletteIndex[value] = static_cast<unsigned char>(index);
+        } else if (m_palette.size() > SCANNED_PALETTE) {
+            updatePaletteIndex();
+        }
+    }
+    return static_cast<unsigned char>(index);
+}
+
+void PalettedStorage::updatePaletteIndex() {
+    if (m_palette.size() <= SCANNED_PALETTE) {
+        m_paletteIndex.clear();
+        m_paletteIndex.shrink_to_fit();
+        return;
+    }
+    m_paletteIndex.assign(256, 0);
+    for (size_t k = 0; k < m_palette.size(); ++k) {
+        m_paletteIndex[m_palette[k]] = static_cast<unsigned char>(k);
+    }
+}
+
+void PalettedStorage::set(size_t i, unsigned char value) {
+    setRun(i, 1, 1, value);
+}
+
+void PalettedStorage::setRun(size_t first, size_t count, size_t stride, unsigned char value) {
+    uint64_t index = indexOf(value);
+    if (m_bits == 0) {
+        // The only value there is
+        return;
+    }
+
+    uint64_t mask = (uint64_t(1) << m_bits) - 1;
+    for (size_t i = first; count > 0; --count, i += stride) {
+        size_t bit = i * m_bits;
+        uint64_t &word = m_words[bit >> 6];
+        word = (word & ~(mask << (bit & 63))) | (index << (bit & 63));
+    }
+}
+
+// Doubles the index width (0 goes to 1) and repacks every entry
+void PalettedStorage::widen() {
+    int bits = m_bits == 0 ? 1 : 2 * m_bits;
+    std::vector<uint64_t> words((m_size * bits + 63) / 64, 0);
+    if (m_bits != 0) {
+        uint64_t oldMask = (uint64_t(1) << m_bits) - 1;
+        for (size_t i = 0; i < m_size; ++i) {
+            size_t oldBit = i * m_bits;
+            uint64_t index = (m_words[oldBit >> 6] >> (oldBit & 63)) & oldMask;
+            size_t bit = i * bits;
+            words[bit >> 6] |= index << (bit & 63);
+        }
+    }
+    m_words.swap(words);
+    m_bits = bits;
+}
+
+void PalettedStorage::compact() {
+    if (m_bits == 0) {
+        return;
+    }
+    uint64_t mask = (uint64_t(1) << m_bits) - 1;
+    std::array<bool, 256> used {};
+    for (size_t i = 0; i < m_size; ++i) {
+        size_t bit = i * m_bits;
+        used[(m_words[bit >> 6] >> (bit & 63)) & mask] = true;
+    }
+
+    // Old palette index -> new one, keeping the values' order
+    std::array<unsigned char, 256> remap {};
+    std::vector<unsigned char> palette;
+    for (size_t k = 0; k < m_palette.size(); ++k) {
+        if (used[k]) {
+            remap[k] = static_cast<unsigned char>(palette.size());
+            palette.push_back(m_palette[k]);
+        }
+    }
+    if (palette.size() == m_palette.size()) {
+        // The width only grows when the palette is full, so it is already the fewest
+        return;
+    }
+    if (palette.size() == 1) {
+        fill(palette[0]);
+        return;
+    }
+
+    int bits = 1;
+    while ((size_t(1) << bits) < palette.size()) {
+        bits *= 2;
+    }
+    std::vector<uint64_t> words((m_size * bits + 63) / 64, 0);
+    for (size_t i = 0; i < m_size; ++i) {
+        size_t oldBit = i * m_bits;
+        uint64_t index = remap[(m_words[oldBit >> 6] >> (oldBit & 63)) & mask];
+        size_t bit = i * bits;
+        words[bit >> 6] |= index << (bit & 63);
+    }
+    m_words.swap(words);
+    m_bits = bits;
+    m_palette.swap(palette);
+    m_palette.shrink_to_fit();
+    updatePaletteIndex();
+}
+
+template <int Bits>
+void PalettedStorage::decodeWith(unsigned char *out) const {
+    const int perWord = 64 / Bits;
+    const uint64_t mask = (uint64_t(1) << Bits) - 1;
+    const unsigned char *palette = m_palette.data();
+    size_t i = 0;
+    for (uint64_t word : m_words) {
+        size_t end = std::min(m_size, i + perWord);
+        for (; i < end; ++i) {
+            out[i] = palette[word & mask];
+            word >>= Bits;
+        }
+    }
+}
+
+void PalettedStorage::decode(unsigned char *out) const {
+    switch (m_bits) {
+    case 0:
+        std::fill_n(out, m_size, m_palette[0]);
+        break;
+    case 1:
+        decodeWith<1>(out);
+        break;
+    case 2:
+        decodeWith<2>(out);
+        break;
+    case 4:
+        decodeWith<4>(out);
+        break;
+    default:
+        decodeWith<8>(out);
+        break;
+    }
+}
+
+size_t PalettedStorage::size() const {
+    return m_size;
+}
+
+int PalettedStorage::bitsPerEntry() const {
+    return m_bits;
+}
+
+const std::vector<unsigned char>& PalettedStorage::palette() const {
+    return m_palette;
+}
+
+size_t PalettedStorage::memoryUsage() const {
+    return m_words.capacity() * sizeof(uint64_t) + m_palette.capacity() + m_paletteIndex.capacity();
+}
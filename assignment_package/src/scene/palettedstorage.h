@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// A fixed-size array of byte values (BlockTypes, for Chunks) stored as indices
+// into a palette of the values that actually occur. Indices are bit-packed
+// into 64-bit words using the fewest bits (0, 1, 2, 4 or 8) that can address
+// the palette, and the width grows automatically as new values are written.
+// Values that are overwritten stay in the palette until compact() drops them.
+// With 0 bits no words are stored at all and every entry is m_palette[0].
+// Widths are powers of two so an index never straddles two words.
+// Not thread-safe: the owner must serialize writes against reads.
+class PalettedStorage {
+private:
+    size_t m_size;
+    int m_bits;
+    std::vector<unsigned char> m_palette;
+    // Position of each value in m_palette, only meaningful for values in it.
+    // Only built once the palette outgrows SCANNED_PALETTE; a smaller one is
+    // searched directly, so most sections store no index at all.
+    std::vector<unsigned char> m_paletteIndex;
+    static const size_t SCANNED_PALETTE = 16;
+    std::vector<uint64_t> m_words;
+
+    void widen();
+    // Rebuilds or drops m_paletteIndex to match the palette's size
+    void updatePaletteIndex();
+    // Position of value in m_palette, adding it (and widening) if needed
+    unsigned char indexOf(unsigned char value);
+    template <int Bits>
+    void decodeWith(unsigned char *out) const;
+
+public:
+    PalettedStorage(size_t size, unsigned char fillValue);
+
+    unsigned char get(size_t i) const;
+    void set(size_t i, unsigned char value);
+    // Sets count entries, stride apart from first on, to value. The palette
+    // is looked up once for the whole run.
+    void setRun(size_t first, size_t count, size_t stride, unsigned char value);
+    // Sets every entry to value, dropping the packed data
+    void fill(unsigned char value);
+    // Drops the palette values no entry holds any more and repacks the
+    // indices at the fewest bits the rest need; 0 bits if one value is left
+    void compact();
+    // Writes all size() entries to out, a word at a time
+    void decode(unsigned char *out) const;
+
+    size_t size() const;
+    int bitsPerEntry() const;
+    const std::vector<unsigned char>& palette() const;
+    // Bytes held on the heap by the packed indices and the palette, not
+    // counting the object itself
+    size_t memoryUsage() const;
+};
+
+inline unsigned char PalettedStorage::get(size_t i) const {
+    if (m_bits == 0) {
+        return m_palette[0];
+    }
+    size_t bit = i * m_bits;
+    uint64_t mask = (uint64_t(1) << m_bits) - 1;
+    return m_palette[(m_words[bit >> 6] >> (bit & 63)) & mask];
+}
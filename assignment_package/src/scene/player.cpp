@@ -1,4 +1,6 @@
 #include "player.h"
+#include "blockregistry.h"
+#include "blockcursor.h"
 #include <QString>
 #include "iostream"
 
@@ -136,6 +138,7 @@ bool Player::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection,
     glm::ivec3 currCell = glm::ivec3(glm::floor(rayOrigin));
     rayDirection = glm::normalize(rayDirection); // now all t values represent world dist
 
+    ConstBlockCursor cursor(terrain);
     float curr_t = 0.f;
     while (curr_t < maxLen) {
         float min_t = glm::sqrt(3.f);
@@ -167,10 +170,11 @@ bool Player::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection,
         glm::ivec3 offset = glm::ivec3(0, 0, 0);
         offset[interfaceAxis] = glm::min(0.f, glm::sign(rayDirection[interfaceAxis]));
         currCell = glm::ivec3(glm::floor(rayOrigin)) + offset;
-        // If the currCell contains something other than empty, return curr_t
-        BlockType cellType = terrain.getBlockAt(currCell.x, currCell.y, currCell.z);
+        // If the currCell contains something other than empty, return curr_t.
+        // Chunks that are not loaded yet have nothing to collide with.
+        BlockType cellType = cursor.get(currCell.x, currCell.y, currCell.z).value_or(EMPTY);
 
-        if (cellType != EMPTY && cellType != WATER) {
+        if (BlockRegistry::isCollidable(cellType)) {
             *out_blockHit = currCell;
             *out_dist = glm::min(maxLen, curr_t);
             return true;
@@ -185,14 +189,12 @@ bool Player::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection,
 bool Player::isOnGroundLevel(const Terrain &terrain, InputBundle &input) {
 
     glm::vec3 bottomLeftVertex = this->m_position - glm::vec3(0.5f, 0.f, 0.5f);
+    ConstBlockCursor cursor(terrain);
     for (int x = 0; x <= 1; x++) {
         for (int z = 0; z <= 1; z++) {
-            if (terrain.getBlockAt(floor(bottomLeftVertex[0]) + x,
-                                   floor(bottomLeftVertex[1] - 0.005f),
-                                   floor(bottomLeftVertex[2]) + z) != EMPTY &&
-                terrain.getBlockAt(floor(bottomLeftVertex[0]) + x,
-                                   floor(bottomLeftVertex[1] - 0.005f),
-                                   floor(bottomLeftVertex[2]) + z) != WATER) {
+            if (BlockRegistry::isCollidable(cursor.get(floor(bottomLeftVertex[0]) + x,
+                                                       floor(bottomLeftVertex[1] - 0.005f),
+                                                       floor(bottomLeftVertex[2]) + z).value_or(EMPTY))) {
 
                 input.isOnGround = true;
                 if (!input.spacePressed) {
@@ -211,11 +213,12 @@ bool Player::isOnGroundLevel(const Terrain &terrain, InputBundle &input) {
 bool Player::isInWater(const Terrain &terrain, InputBundle &input) {
 
     glm::vec3 bottomLeftVertex = this->m_position - glm::vec3(0.5f, -0.5f, 0.5f);
+    ConstBlockCursor cursor(terrain);
     for (int x = 0; x <= 1; x++) {
         for (int z = 0; z <= 1; z++) {
-            if (terrain.getBlockAt(floor(bottomLeftVertex[0]) + x,
-                                   floor(bottomLeftVertex[1] - 0.005f),
-                                   floor(bottomLeftVertex[2]) + z) != WATER) {
+            if (cursor.get(floor(bottomLeftVertex[0]) + x,
+                           floor(bottomLeftVertex[1] - 0.005f),
+                           floor(bottomLeftVertex[2]) + z) != WATER) {
 
                 input.isInWater = false;
                 return false;
@@ -235,8 +238,7 @@ void Player::destroyBlock(Terrain *terrain) {
 
     if (gridMarch(rayOrigin, rayDirection, *terrain, &out_dist, &out_blockHit)) {
         std::cout << "destroy this!" << std::endl;
-        terrain->setBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z, EMPTY);
-        terrain->getChunkAt(out_blockHit.x, out_blockHit.z).get()->destroy();
+        terrain->editBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z, EMPTY);
     }
 }
 
@@ -248,13 +250,17 @@ void Player::createBlock(Terrain *terrain) {
 
     if (gridMarch(rayOrigin, rayDirection, *terrain, &out_dist, &out_blockHit)) {
         std::cout << "create this!" << std::endl;
+        glm::ivec3 placed = out_blockHit;
         if (ifAxis == 0) {
-            terrain->setBlockAt(out_blockHit.x, out_blockHit.y, out_blockHit.z + glm::sign(rayDirection.z), STONE);
+            placed.z += glm::sign(rayDirection.z);
         } else if (ifAxis == 1) {
-            terrain->setBlockAt(out_blockHit.x, out_blockHit.y + glm::sign(rayDirection.y), out_blockHit.z , STONE);
+            placed.y += glm::sign(rayDirection.y);
         } else if (ifAxis == 2) {
-            terrain->setBlockAt(out_blockHit.x + glm::sign(rayDirection.x), out_blockHit.y, out_blockHit.z, STONE);
+            placed.x += glm::sign(rayDirection.x);
+        } else {
+            return;
         }
+        terrain->editBlockAt(placed.x, placed.y, placed.z, STONE);
     }
 }
 
@@ -1,8 +1,12 @@
 #include "river.h"
+#include <algorithm>
+#include <cmath>
+#include "blockcursor.h"
 
 River::River(Terrain *m_terrain, int terrainx, int terrainz) :
     m_terrain(m_terrain), terrainx(terrainx), terrainz(terrainz), turtles(std::stack<Turtle>()),
-    grammer("FX"), currTurtle(nullptr), iteration(2), length(10), depth(0), drawingRules()
+    grammer("FX"), currTurtle(nullptr), iteration(2), length(10), depth(0), drawingRules(),
+    random(zoneSeed(terrainx, terrainz, 1))
 {
     for (int i = 0; i < iteration; i++) {
         expand();
@@ -15,8 +19,7 @@ void River::expand() {
     for (int i = 0; i < grammer.length(); i++) {
 
         if (grammer[i] == 'X') {
-            double random = ((double) rand() / (RAND_MAX));
-            if (random < 0.5) {
+            if (std::uniform_real_distribution<double>(0, 1)(random) < 0.5) {
                 temp.append("[+FX]-FX");
             } else {
                 temp.append("[+FX][FX]-FX");
@@ -36,13 +39,13 @@ void River::goForward() {
     int riverLength = std::max((int) length * depth, 12);
     float newx, newz;
     int rotatedx, rotatedz;
-    double random = ((double) rand() / (RAND_MAX));
-    if (random > 0.5) random = 1;
-    else random = -1;
+    double side = std::uniform_real_distribution<double>(0, 1)(random);
+    if (side > 0.5) side = 1;
+    else side = -1;
 
     for (int i = 0; i < riverLength; i++) {
         float step = i * 2 * PI / riverLength;
-        float offset = random * sin(step) * depth;
+        float offset = side * sin(step) * depth;
         newx = currTurtle->posx + offset;
         newz = currTurtle->posz + i;
         rotatedx = int(cos(currTurtle->orientation) * (newx - currTurtle->posx) - sin(currTurtle->orientation) *
@@ -60,46 +63,35 @@ void River::goForward() {
 
 // expands the river width by coloring neighbor blocks
 void River::colorNeighbors(int x, int z, int radius, int depth) {
+    BlockCursor cursor(*m_terrain);
     for (int i = -radius; i <= radius; i++) { //x
         for (int k = -radius; k <= radius; k++) { //z
-            for (int j = -radius; j <= radius; j++) { //y
-                if (terrainx <= x + i && x + i < terrainx + 64 && terrainz <= z + k && z + k < terrainz + 64 &&
-                        i*i + j*j + k*k <= radius*radius) {
-                    if (j <= -depth) {
-                        if (m_terrain->hasChunkAt(x + i, z + k)) {
-                            if (m_terrain->hasChunkAt(x + i, z + k))
-                                m_terrain->setBlockAt(x + i, 128 + radius + j, z + k, WATER);
-                        }
-
-                    } else {
-                        if (m_terrain->hasChunkAt(x + i, z + k)) {
-                            if (m_terrain->hasChunkAt(x + i, z + k))
-                                m_terrain->setBlockAt(x + i, 128 + radius + j, z + k, EMPTY);
-                        }
-                    }
-                }
+            // Rivers stay within their own terrain zone, in Chunks that exist
+            if (!(terrainx <= x + i && x + i < terrainx + 64 && terrainz <= z + k && z + k < terrainz + 64) ||
+                    cursor.chunkAt(x + i, z + k) == nullptr) {
+                continue;
             }
-            if (terrainx <= x + i && x + i < terrainx + 64 && terrainz <= z + k && z + k < terrainz + 64) {
-                if (m_terrain->hasChunkAt(x + i, z + k)) {
-                    for (int m = 128 + radius; m < 255; m++) {
-                        if (m <= 128 + radius * 2) {
-                            if (m_terrain->hasChunkAt(x + i, z + k))
-                                m_terrain->setBlockAt(x + i, m, z + k, EMPTY);
-                        } else {
-                            if (m_terrain->getBlockAt(x + i, m, z + k) == EMPTY) {
-                                break;
-                            } else {
-                                if (m_terrain->hasChunkAt(x + i, z + k))
-                                    m_terrain->setBlockAt(x + i, m, z + k, EMPTY);
-                            }
-                        }
-
-                    }
-                }
-
+            // The fills below lock the Chunk themselves
+            cursor.release();
+            // This column of the sphere around (x, 128 + radius, z):
+            // water up to depth below its center, air above
+            int rest = radius*radius - i*i - k*k;
+            if (rest >= 0) {
+                int h = static_cast<int>(std::sqrt(static_cast<float>(rest)));
+                int center = 128 + radius;
+                m_terrain->fillColumn(x + i, z + k, center - h, center + std::min(h, -depth) + 1, WATER);
+                m_terrain->fillColumn(x + i, z + k, center + std::max(-h, 1 - depth), center + h + 1, EMPTY);
             }
-
-
+            // Clear the bank above the river, and whatever rests on it up to
+            // the first gap. Everything above the column's highest block is
+            // already EMPTY.
+            int top = std::min(254, m_terrain->getHighestBlockAt(x + i, z + k));
+            int m = 128 + radius * 2 + 1;
+            while (m <= top && cursor.getUnchecked(x + i, m, z + k) != EMPTY) {
+                m++;
+            }
+            cursor.release();
+            m_terrain->fillColumn(x + i, z + k, 128 + radius, std::min(m, top + 1), EMPTY);
         }
     }
 }
@@ -135,13 +127,13 @@ void River::draw() {
             break;
         case '+':
         {
-            float randNum = 30 + rand() % (60 - 40 + 1);
+            float randNum = 30 + std::uniform_int_distribution<int>(0, 60 - 40)(random);
             currTurtle->orientation += randNum * PI / 180.f;
             break;
         }
         case '-':
         {
-            float randNum = 30 + rand() % (60 - 40 + 1);
+            float randNum = 30 + std::uniform_int_distribution<int>(0, 60 - 40)(random);
             currTurtle->orientation -= randNum * PI / 180.f;
             break;
         }
@@ -25,6 +25,8 @@ public:
     int length;
     int depth;
     std::map<char, Rule> drawingRules;
+    // Seeded by the zone, see zoneSeed
+    std::minstd_rand random;
     void expand();
     void draw();
     void colorNeighbors(int, int, int, int);
@@ -2,14 +2,25 @@
 #include "cube.h"
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <random>
 #include "river.h"
+#include "blockcursor.h"
+#include "src/meshbufferpool.h"
+#include "noisegrid.h"
 
 Terrain::Terrain(OpenGLContext *context)
-    : m_chunks(), m_generatedTerrain(), mp_context(context)
+    : m_chunks(), m_grid(CHUNK_GRID_SIZE_LOG2), m_generatedTerrain(), m_voxelRadius(DEFAULT_VOXEL_RADIUS),
+      m_heightfields(), m_sampling(), m_memoryBudget(DEFAULT_MEMORY_BUDGET),
+      m_frame(0), m_ticksSinceUnload(0), m_epochMutex(), m_epoch(0), m_activeWork(),
+      m_retiredChunks(), m_savedChunks(), m_savedChunksMutex(),
+      mp_context(context), m_quadIndices(context)
 {}
 
 Terrain::~Terrain() {
     //m_geomCube.destroy();
+    m_quadIndices.destroy();
 }
 
 // Combine two 32-bit ints into one 64-bit int
@@ -44,21 +55,24 @@ glm::ivec2 toCoords(int64_t k) {
     return glm::ivec2(x, z);
 }
 
+uint32_t zoneSeed(int x, int z, uint32_t salt) {
+    std::seed_seq seq {static_cast<uint32_t>(x), static_cast<uint32_t>(z), salt};
+    uint32_t seed;
+    seq.generate(&seed, &seed + 1);
+    return seed;
+}
+
 // Surround calls to this with try-catch if you don't know whether
 // the coordinates at x, y, z have a corresponding Chunk
 BlockType Terrain::getBlockAt(int x, int y, int z) const
 {
-    if(hasChunkAt(x, z)) {
+    if(const Chunk *c = findChunkAt(x, z)) {
         // Just disallow action below or above min/max height,
         // but don't crash the game over it.
         if(y < 0 || y >= 256) {
             return EMPTY;
         }
-        const uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        return c->getBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
-                             static_cast<unsigned int>(y),
-                             static_cast<unsigned int>(z - chunkOrigin.y));
+        return c->getBlockAt(x & 15, y, z & 15);
     }
     else {
         throw std::out_of_range("Coordinates " + std::to_string(x) +
@@ -72,83 +86,174 @@ BlockType Terrain::getBlockAt(glm::vec3 p) const {
 }
 
 bool Terrain::hasChunkAt(int x, int z) const {
-    // Map x and z to their nearest Chunk corner
-    // By flooring x and z, then multiplying by 16,
-    // we clamp (x, z) to its nearest Chunk-space corner,
-    // then scale back to a world-space location.
-    // Note that floor() lets us handle negative numbers
-    // correctly, as floor(-1 / 16.f) gives us -1, as
-    // opposed to (int)(-1 / 16.f) giving us 0 (incorrect!).
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks.find(toKey(16 * xFloor, 16 * zFloor)) != m_chunks.end();
+    return findChunkAt(x, z) != nullptr;
 }
 
-
-uPtr<Chunk>& Terrain::getChunkAt(int x, int z) {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    int64_t key = toKey(16 * xFloor, 16 * zFloor);
-    uPtr<Chunk> &ref = m_chunks[key];
-    if(ref == nullptr) {
-        std::cout << "Got null at " << xFloor << ", " << zFloor << std::endl;
+Chunk* Terrain::getChunkAt(int x, int z) const {
+    Chunk *c = findChunkAt(x, z);
+    if(c == nullptr) {
+        std::cout << "Got null at " << (x >> 4) << ", " << (z >> 4) << std::endl;
     }
-    return ref;
+    return c;
 }
 
-
-const uPtr<Chunk>& Terrain::getChunkAt(int x, int z) const {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    const uPtr<Chunk> &ref = m_chunks.at(toKey(16 * xFloor, 16 * zFloor));
-    if(ref == nullptr) {
-        std::cout << "Got null at " << xFloor << ", " << zFloor << std::endl;
+Chunk* Terrain::findChunkAt(int x, int z) const {
+    if (Chunk *c = m_grid.find(x, z)) {
+        return c;
     }
-    return ref;
+    // Map x and z to their Chunk's corner: clearing the low four bits
+    // floors to a multiple of 16, negative numbers included
+    return m_chunks.find(toKey(x & ~15, z & ~15));
 }
 
 void Terrain::setBlockAt(int x, int y, int z, BlockType t)
 {
-    if(hasChunkAt(x, z)) {
-        uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        c->setBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
+    if(Chunk *c = findChunkAt(x, z)) {
+        c->setBlockAt(static_cast<unsigned int>(x & 15),
                       static_cast<unsigned int>(y),
-                      static_cast<unsigned int>(z - chunkOrigin.y),
+                      static_cast<unsigned int>(z & 15),
                       t);
     }
     else {
-        hasChunkAt(x, z);
         throw std::out_of_range("Coordinates " + std::to_string(floor(x / 16.f) * 16) +
                                 " " + std::to_string(y) + " " +
                                 std::to_string(floor(z / 16.f) * 16) + " have no Chunk!");
     }
 }
 
+void Terrain::fillColumn(int x, int z, int yMin, int yMax, BlockType t, const BlockFilter &filter) {
+    fillBox(glm::ivec3(x, yMin, z), glm::ivec3(x + 1, yMax, z + 1), t, filter);
+}
 
-Chunk* Terrain::createChunkAt(int x, int z) {
-    uPtr<Chunk> chunk = mkU<Chunk>(mp_context);
-    Chunk *cPtr = chunk.get();
-    chunk->setWorldPos(x, z);
+void Terrain::fillBox(glm::ivec3 lo, glm::ivec3 hi, BlockType t, const BlockFilter &filter) {
+    lo.y = std::max(lo.y, 0);
+    hi.y = std::min(hi.y, 256);
+    if (glm::any(glm::greaterThanEqual(lo, hi))) {
+        return;
+    }
+    for (int chunkX = lo.x & ~15; chunkX < hi.x; chunkX += 16) {
+        for (int chunkZ = lo.z & ~15; chunkZ < hi.z; chunkZ += 16) {
+            if (Chunk *c = findChunkAt(chunkX, chunkZ)) {
+                glm::ivec3 origin(chunkX, 0, chunkZ);
+                c->fillBox(glm::max(lo - origin, glm::ivec3(0)),
+                           glm::min(hi - origin, glm::ivec3(16, 256, 16)), t, filter);
+            }
+        }
+    }
+}
+
+// Largest integer whose square is at most n
+static int floorSqrt(int n) {
+    int r = static_cast<int>(std::sqrt(static_cast<float>(n)));
+    while (r * r > n) {
+        --r;
+    }
+    while ((r + 1) * (r + 1) <= n) {
+        ++r;
+    }
+    return r;
+}
+
+void Terrain::fillSphere(glm::ivec3 center, int radiusSquared, BlockType t,
+                         const BlockFilter &filter, int yMin, int yMax) {
+    if (radiusSquared < 0) {
+        return;
+    }
+    int radius = floorSqrt(radiusSquared);
+    glm::ivec3 lo = center - glm::ivec3(radius);
+    glm::ivec3 hi = center + glm::ivec3(radius + 1);
+    // Every column of the sphere is one run of blocks
+    for (int chunkX = lo.x & ~15; chunkX < hi.x; chunkX += 16) {
+        for (int chunkZ = lo.z & ~15; chunkZ < hi.z; chunkZ += 16) {
+            Chunk *c = findChunkAt(chunkX, chunkZ);
+            if (c == nullptr) {
+                continue;
+            }
+            for (int x = std::max(lo.x, chunkX); x < std::min(hi.x, chunkX + 16); ++x) {
+                for (int z = std::max(lo.z, chunkZ); z < std::min(hi.z, chunkZ + 16); ++z) {
+                    int dx = x - center.x;
+                    int dz = z - center.z;
+                    int rest = radiusSquared - dx * dx - dz * dz;
+                    if (rest < 0) {
+                        continue;
+                    }
+                    int h = floorSqrt(rest);
+                    int y0 = std::max({center.y - h, yMin, 0});
+                    int y1 = std::min({center.y + h + 1, yMax, 256});
+                    c->fillBox(glm::ivec3(x - chunkX, y0, z - chunkZ),
+                               glm::ivec3(x - chunkX + 1, y1, z - chunkZ + 1), t, filter);
+                }
+            }
+        }
+    }
+}
 
-    m_chunks[toKey(x, z)] = std::move(chunk);
-    // Set the neighbor pointers of itself and its neighbors
-    if(hasChunkAt(x, z + 16)) {
-        auto &chunkNorth = m_chunks[toKey(x, z + 16)];
-        cPtr->linkNeighbor(chunkNorth, ZPOS);
+int Terrain::getHighestBlockAt(int x, int z) const
+{
+    if(const Chunk *c = findChunkAt(x, z)) {
+        return c->getHighestBlockAt(x & 15, z & 15);
     }
-    if(hasChunkAt(x, z - 16)) {
-        auto &chunkSouth = m_chunks[toKey(x, z - 16)];
-        cPtr->linkNeighbor(chunkSouth, ZNEG);
+    throw std::out_of_range("Coordinates " + std::to_string(x) + " " +
+                            std::to_string(z) + " have no Chunk!");
+}
+
+int Terrain::getLowestExposedAt(int x, int z) const
+{
+    if(const Chunk *c = findChunkAt(x, z)) {
+        return c->getLowestExposedAt(x & 15, z & 15);
     }
-    if(hasChunkAt(x + 16, z)) {
-        auto &chunkEast = m_chunks[toKey(x + 16, z)];
-        cPtr->linkNeighbor(chunkEast, XPOS);
+    throw std::out_of_range("Coordinates " + std::to_string(x) + " " +
+                            std::to_string(z) + " have no Chunk!");
+}
+
+
+void Terrain::editBlockAt(int x, int y, int z, BlockType t) {
+    setBlockAt(x, y, z, t);
+    // setBlockAt threw if there was no Chunk
+    findChunkAt(x, z)->markEdited();
+    markDirtyAround(x, y, z);
+}
+
+void Terrain::markDirtyAround(int x, int y, int z) {
+    if (y < 0 || y >= 256) {
+        return;
     }
-    if(hasChunkAt(x - 16, z)) {
-        auto &chunkWest = m_chunks[toKey(x - 16, z)];
-        cPtr->linkNeighbor(chunkWest, XNEG);
+    // Every block whose faces can change: the edited one and its six neighbors
+    std::vector<glm::ivec3> touched {glm::ivec3(x, y, z),
+                                     glm::ivec3(x + 1, y, z), glm::ivec3(x - 1, y, z),
+                                     glm::ivec3(x, y + 1, z), glm::ivec3(x, y - 1, z),
+                                     glm::ivec3(x, y, z + 1), glm::ivec3(x, y, z - 1)};
+    // At most three Chunks, each with the sections touched in it
+    std::vector<std::pair<Chunk*, uint16_t>> dirty;
+    for (const glm::ivec3 &p : touched) {
+        Chunk *c = findChunkAt(p.x, p.z);
+        if (p.y < 0 || p.y >= 256 || c == nullptr) {
+            continue;
+        }
+        auto it = std::find_if(dirty.begin(), dirty.end(), [c](const std::pair<Chunk*, uint16_t> &d) {
+            return d.first == c;
+        });
+        if (it == dirty.end()) {
+            dirty.emplace_back(c, 0);
+            it = dirty.end() - 1;
+        }
+        it->second |= 1 << (p.y / 16);
+    }
+    for (const auto &d : dirty) {
+        d.first->markDirty(d.second);
+        // Chunks that were never meshed are meshed whole once they are scheduled
+        if (d.first->state() == ChunkState::DIRTY) {
+            chunksWithOnlyBlockData.push(d.first);
+        }
     }
+}
+
+Chunk* Terrain::createChunkAt(int x, int z) {
+    uPtr<Chunk> chunk = mkU<Chunk>(mp_context);
+    chunk->setWorldPos(x, z);
+    // Also sets the neighbor pointers of itself and its neighbors
+    Chunk *cPtr = m_chunks.insert(x, z, std::move(chunk));
+    m_grid.place(cPtr);
     return cPtr;
 }
 
@@ -191,6 +296,7 @@ void Terrain::updateScene(glm::vec3 pos, ShaderProgram *shaderProgram) {
             }
         }
         forward->setWorldPos(x, z +16);
+        forward->markBlocksReady();
         forward->create();
     }
     if (backward != nullptr) {
@@ -202,6 +308,7 @@ void Terrain::updateScene(glm::vec3 pos, ShaderProgram *shaderProgram) {
             }
         }
         backward->setWorldPos(x, z -16);
+        backward->markBlocksReady();
         backward->create();
     }
     if (right != nullptr) {
@@ -213,6 +320,7 @@ void Terrain::updateScene(glm::vec3 pos, ShaderProgram *shaderProgram) {
             }
         }
         right->setWorldPos(x +16, z);
+        right->markBlocksReady();
         right->create();
     }
     if (left != nullptr) {
@@ -224,6 +332,7 @@ void Terrain::updateScene(glm::vec3 pos, ShaderProgram *shaderProgram) {
             }
         }
         left->setWorldPos(x -16, z);
+        left->markBlocksReady();
         left->create();
     }
 
@@ -238,15 +347,16 @@ void Terrain::setTime(int t) {
 // it draws each Chunk with the given ShaderProgram, remembering to set the
 // model matrix to the proper X and Z translation!(Elaine 1st)
 void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram) {
+    ++m_frame;
     for(int x = minX; x < maxX; x += 16) {
         for(int z = minZ; z < maxZ; z += 16) {
-            if (hasChunkAt(x, z)) {
-                const uPtr<Chunk> &chunk = getChunkAt(x, z);
+            Chunk *chunk = findChunkAt(x, z);
+            if (chunk != nullptr && chunk->blocksReady()) {
+                chunk->touch(m_frame);
                 if(chunk->elemCountOpq() > 0) {
-
-                    chunk->setWorldPos(x, z);
                     shaderProgram->setModelMatrix(glm::mat4());
-                    shaderProgram->drawInterleaved(*chunk, 0, 0, time);
+                    shaderProgram->setChunkOrigin(chunk->meshOrigin());
+                    shaderProgram->drawInterleaved(*chunk, m_quadIndices, 0, 0, time);
                 }
 
             }
@@ -254,12 +364,12 @@ void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shader
     }
     for(int x = minX; x < maxX; x += 16) {
         for(int z = minZ; z < maxZ; z += 16) {
-            if (hasChunkAt(x, z)) {
-                const uPtr<Chunk> &chunk = getChunkAt(x, z);
+            Chunk *chunk = findChunkAt(x, z);
+            if (chunk != nullptr && chunk->blocksReady()) {
                 if(chunk->elemCountTran() > 0) {
-                    chunk->setWorldPos(x, z);
                     shaderProgram->setModelMatrix(glm::mat4());
-                    shaderProgram->drawInterleaved(*chunk, 0, 1, time);
+                    shaderProgram->setChunkOrigin(chunk->meshOrigin());
+                    shaderProgram->drawInterleaved(*chunk, m_quadIndices, 0, 1, time);
                 }
             }
         }
@@ -268,9 +378,15 @@ void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shader
 
 //calls chunk.create() to make vbo data (Elaine 1st)
 void Terrain::createChunks(int minx, int maxx, int minz, int maxz) {
+    // Filled before this is called, so their borders can be read
     for(int x = minx; x < maxx; x += 16) {
         for(int z = minz; z < maxz; z += 16) {
-            const uPtr<Chunk> &chunk = getChunkAt(x, z);
+            getChunkAt(x, z)->markBlocksReady();
+        }
+    }
+    for(int x = minx; x < maxx; x += 16) {
+        for(int z = minz; z < maxz; z += 16) {
+            Chunk *chunk = getChunkAt(x, z);
             chunk->destroy();
             chunk->setWorldPos(x, z);
             chunk->create();
@@ -308,61 +424,63 @@ void Terrain::CreateTestScene()
 
 }
 
-void Terrain::fillBlock(int x, int z) {
-    int mheight = getMountainHeight(x, z);
-    int gheight = getGrasslandHeight(x, z);
-    int sheight = getSandHeight(x, z);
-    float t = perlinNoise(glm::vec2(x / 256.f, z / 256.f));
+ColumnSurface Terrain::getColumnSurface(int x, int z) {
+    return blendColumn(getMountainHeight(x, z), getGrasslandHeight(x, z), getSandHeight(x, z),
+                       perlinNoise(glm::vec2(x / 256.f, z / 256.f)),
+                       perlinNoise(glm::vec2(x / 200.f, z / 200.f)));
+}
+
+ColumnSurface Terrain::blendColumn(int mheight, int gheight, int sheight, float t, float t2) {
     float remapped = remap(t, -1, 1, 0, 1);
     remapped = glm::smoothstep(0.4, 0.6, (double) remapped);
     int lerp = int((1 - remapped) * gheight + remapped * mheight);
 
-    float t2 = perlinNoise(glm::vec2(x / 200.f, z / 200.f));
     float remapped2 = remap(t2, -1, 1, 0, 1);
     remapped2 = glm::smoothstep(0.15, 0.75, (double) remapped2);
     int lerp2 = int((1 - remapped2) * lerp + remapped2 * sheight);
     lerp = max(132, lerp);
     lerp2 = max(132, lerp2);
 
+    ColumnSurface column;
     if (remapped < 0.7) {
         if (remapped2 > 0.4) {
-             for (int y = 0; y < lerp; ++y) {
-                if (y == lerp - 1) {
-                    setBlockAt(x, y, z, GRASS);
-                } else if (y <= 128) {
-                    setBlockAt(x, y, z, STONE);
-                } else {
-                    setBlockAt(x, y, z, DIRT);
-                }
-            }
+            column.top = lerp;
+            column.filler = DIRT;
+            column.surface = GRASS;
         } else {
             if (remapped2 < 0.35) {
                 lerp2 = remap(lerp2, 128, 255, 128, 200);
             }
             lerp2 = max(lerp2, 132);
-            for (int y = 0; y < lerp2; ++y) {
-               if (y == lerp2 - 1) {
-                   setBlockAt(x, y, z, SAND);
-               } else if (y <= 128) {
-                   setBlockAt(x, y, z, STONE);
-               } else {
-                   setBlockAt(x, y, z, SAND);
-               }
-           }
+            column.top = lerp2;
+            column.filler = SAND;
+            column.surface = SAND;
         }
     } else { // mountain
-        for (int y = 0; y < lerp; ++y) {
-            if (y == lerp - 1 && lerp > 200) {
-                setBlockAt(x, y, z, SNOW);
-            } else if (y == lerp - 1) {
-                setBlockAt(x, y, z, STONE);
-            } else if (y <= 128) {
-                setBlockAt(x, y, z, STONE);
-            } else {
-                setBlockAt(x, y, z, STONE);
-            }
-        }
+        column.top = lerp;
+        column.filler = STONE;
+        column.surface = lerp > 200 ? SNOW : STONE;
     }
+    return column;
+}
+
+void Terrain::fillBlock(int x, int z) {
+    // Each column is stone up to y = 128, a filler block above that and
+    // a surface block on top, written as three runs
+    ColumnSurface column = getColumnSurface(x, z);
+    fillColumn(x, z, 0, min(129, column.top - 1), STONE);
+    fillColumn(x, z, 129, column.top - 1, column.filler);
+    fillColumn(x, z, column.top - 1, column.top, column.surface);
+}
+
+int Terrain::getSurfaceHeightAt(int x, int z) {
+    int zoneX = x & ~63;
+    int zoneZ = z & ~63;
+    auto it = m_heightfields.find(toKey(zoneX, zoneZ));
+    if (it != m_heightfields.end()) {
+        return it->second->at(x - zoneX, z - zoneZ).top;
+    }
+    return getColumnSurface(x, z).top;
 }
 
 float Terrain::perlinNoise(glm::vec2 uv) {
@@ -377,19 +495,15 @@ float Terrain::perlinNoise(glm::vec2 uv) {
 }
 
 
-glm::vec2 random2(glm::vec2 p) {
-    return glm::fract(glm::sin(glm::vec2(glm::dot(p, glm::vec2(127.1, 311.7)),
-                          glm::dot(p, glm::vec2(269.5, 183.3)))) * 43758.5453f);
-}
-
 float Terrain::remap(float val, float from1, float to1, float from2, float to2) {
     return (val - from1) / (to1 - from1) * (to2 - from2) + from2;
 }
 
 float Terrain::surflet(glm::vec2 p, glm::vec2 gridPoint) {
     glm::vec2 t2 = glm::abs(p - gridPoint);
-    glm::vec2 t = glm::vec2(1.f) - (6.f * glm::pow(t2, glm::vec2(5.f)) - 15.f * glm::pow(t2, glm::vec2(4.f)) +
-            10.f * glm::pow(t2, glm::vec2(3.f)));
+    // 1 - (6 t^5 - 15 t^4 + 10 t^3), multiplied out in the order NoiseGrid
+    // uses, so both round alike
+    glm::vec2 t = glm::vec2(1.f) - t2 * t2 * t2 * (t2 * (t2 * 6.f - 15.f) + 10.f);
     glm::vec2 rand = random2(gridPoint);
     rand[0] = remap(rand[0], 0, 1, -1, 1);
     rand[1] = remap(rand[1], 0, 1, -1, 1);
@@ -402,12 +516,22 @@ float Terrain::surflet(glm::vec2 p, glm::vec2 gridPoint) {
 
 
 int Terrain::getGrasslandHeight(int x, int z) {
-    float worley = worleyNoise(glm::vec2(x / 64.f, z / 64.f));
-    return 129 + (worley) * 127 / 2 + 5;
+    return grasslandHeightOf(worleyNoise(glm::vec2(x / 64.f, z / 64.f)));
 }
 
 int Terrain::getMountainHeight(int x, int z) {
-    float perlin = perlinNoise(glm::vec2(x / 32.f, z / 32.f));
+    return mountainHeightOf(perlinNoise(glm::vec2(x / 32.f, z / 32.f)));
+}
+
+int Terrain::getSandHeight(int x, int z) {
+    return sandHeightOf(worleyNoise(glm::vec2(x / 64.f, z / 64.f)));
+}
+
+int Terrain::grasslandHeightOf(float worley) {
+    return 129 + (worley) * 127 / 2 + 5;
+}
+
+int Terrain::mountainHeightOf(float perlin) {
     perlin = remap(perlin, -1, 1, 0, 1);
 
     perlin = glm::smoothstep(0.25, 0.75, (double) perlin);
@@ -417,8 +541,7 @@ int Terrain::getMountainHeight(int x, int z) {
 
 }
 
-int Terrain::getSandHeight(int x, int z) {
-    float worley = worleyNoise(glm::vec2(x / 64.f, z / 64.f));
+int Terrain::sandHeightOf(float worley) {
     return 129 + (worley) * 5;
 }
 
@@ -476,7 +599,7 @@ float Terrain::interpNoise1D(float x) {
  */
 
 
-// Examines 5 by 5 terrain zone from the current player position
+// Examines the terrain zones within the voxel radius of the current player position
 // Returns relative positions of terrains that need to be created
 std::vector<int64_t> Terrain::checkExpansion(glm::vec3 position) {
     std::vector<int64_t> output;
@@ -485,8 +608,8 @@ std::vector<int64_t> Terrain::checkExpansion(glm::vec3 position) {
 
 
     // Check Current
-    for (int r = -2; r <= 2; r++) {
-        for (int c = -2; c <= 2; c++) {
+    for (int r = -m_voxelRadius; r <= m_voxelRadius; r++) {
+        for (int c = -m_voxelRadius; c <= m_voxelRadius; c++) {
             int64_t currTerrain = toKey((lowerLeftX + c) * 64, (lowerLeftZ + r) * 64);
             if (m_generatedTerrain.find(currTerrain) == m_generatedTerrain.end()) {
                 m_generatedTerrain.insert(currTerrain);
@@ -498,6 +621,361 @@ std::vector<int64_t> Terrain::checkExpansion(glm::vec3 position) {
     return output;
 }
 
+std::vector<int64_t> Terrain::checkHeightfieldExpansion(glm::vec3 position) {
+    int zoneX = glm::floor(position.x / 64.0f);
+    int zoneZ = glm::floor(position.z / 64.0f);
+    std::vector<std::pair<int, int64_t>> missing;
+    for (int r = -HEIGHTFIELD_RADIUS; r <= HEIGHTFIELD_RADIUS; r++) {
+        for (int c = -HEIGHTFIELD_RADIUS; c <= HEIGHTFIELD_RADIUS; c++) {
+            int64_t zone = toKey((zoneX + c) * 64, (zoneZ + r) * 64);
+            // The job voxelizing a zone without a heightfield makes one
+            if (m_heightfields.count(zone) || m_sampling.count(zone) || m_generatedTerrain.count(zone)) {
+                continue;
+            }
+            missing.emplace_back(glm::max(glm::abs(r), glm::abs(c)), zone);
+        }
+    }
+    // Zones next to the voxel radius are needed first
+    std::sort(missing.begin(), missing.end());
+    std::vector<int64_t> output;
+    output.reserve(missing.size());
+    for (const auto &m : missing) {
+        m_sampling.insert(m.second);
+        output.push_back(m.second);
+    }
+    return output;
+}
+
+void Terrain::updateHeightfields(glm::vec3 position) {
+    for (auto &done : zonesWithHeightfields.takeAll()) {
+        m_sampling.erase(done.first);
+        m_heightfields.emplace(done.first, std::move(done.second));
+    }
+    // A zone past the radius, so walking along its edge does not make the
+    // same heightfields over and over
+    int zoneX = glm::floor(position.x / 64.0f);
+    int zoneZ = glm::floor(position.z / 64.0f);
+    for (auto it = m_heightfields.begin(); it != m_heightfields.end();) {
+        glm::ivec2 corner = toCoords(it->first);
+        int distance = glm::max(glm::abs(corner.x / 64 - zoneX), glm::abs(corner.y / 64 - zoneZ));
+        if (distance > HEIGHTFIELD_RADIUS + 1) {
+            it = m_heightfields.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
 
+sPtr<const ZoneHeightfield> Terrain::heightfieldOf(int64_t zone) const {
+    auto it = m_heightfields.find(zone);
+    return it == m_heightfields.end() ? nullptr : it->second;
+}
 
+void Terrain::setVoxelRadius(int zones) {
+    m_voxelRadius = glm::clamp(zones, 0, MAX_VOXEL_RADIUS);
+}
+
+int Terrain::voxelRadius() const {
+    return m_voxelRadius;
+}
 
+void Terrain::recenter(glm::vec3 position) {
+    m_grid.recenter(static_cast<int>(glm::floor(position.x)),
+                    static_cast<int>(glm::floor(position.z)), m_chunks);
+}
+
+void Terrain::updateLevelsOfDetail(glm::vec3 position) {
+    auto levelOfRing = [](int ring) {
+        return glm::min(glm::max(ring - 1, 0) / LEVEL_OF_DETAIL_RING, Chunk::MAX_LEVEL_OF_DETAIL);
+    };
+    int chunkX = glm::floor(position.x / 16.0f);
+    int chunkZ = glm::floor(position.z / 16.0f);
+    int zoneX = glm::floor(position.x / 64.0f) * 64;
+    int zoneZ = glm::floor(position.z / 64.0f) * 64;
+    const int reach = m_voxelRadius * 64;
+    for (int x = zoneX - reach; x < zoneX + reach + 64; x += 16) {
+        for (int z = zoneZ - reach; z < zoneZ + reach + 64; z += 16) {
+            Chunk *c = findChunkAt(x, z);
+            if (c == nullptr) {
+                continue;
+            }
+            int ring = glm::max(glm::abs(x / 16 - chunkX), glm::abs(z / 16 - chunkZ));
+            int level = c->levelOfDetail();
+            int wanted = levelOfRing(ring);
+            if (wanted < level || (wanted > level && levelOfRing(ring - 1) > level)) {
+                c->setLevelOfDetail(wanted);
+                // Chunks not meshed yet get the new level with their first mesh
+                if (c->state() >= ChunkState::MESHING) {
+                    c->markDirty();
+                    chunksWithOnlyBlockData.push(c);
+                }
+            }
+        }
+    }
+}
+
+
+
+
+
+void Terrain::setMemoryBudget(size_t bytes) {
+    m_memoryBudget = bytes;
+}
+
+size_t Terrain::memoryBudget() const {
+    return m_memoryBudget;
+}
+
+size_t Terrain::memoryUsage() const {
+    size_t bytes = 0;
+    m_chunks.forEach([&bytes](Chunk *c) {
+        bytes += c->memoryUsage();
+    });
+    QMutexLocker locker(&m_savedChunksMutex);
+    for (const auto &saved : m_savedChunks) {
+        bytes += Chunk::sectionsMemoryUsage(saved.second);
+    }
+    return bytes;
+}
+
+uint64_t Terrain::beginWork() {
+    QMutexLocker locker(&m_epochMutex);
+    ++m_activeWork[m_epoch];
+    return m_epoch;
+}
+
+void Terrain::endWork(uint64_t epoch) {
+    QMutexLocker locker(&m_epochMutex);
+    auto it = m_activeWork.find(epoch);
+    if (--it->second == 0) {
+        m_activeWork.erase(it);
+    }
+}
+
+void Terrain::unloadChunks(glm::vec3 position) {
+    freeRetiredChunks();
+    // Measuring walks every Chunk, so only do it about once a second
+    if (++m_ticksSinceUnload < 60) {
+        return;
+    }
+    m_ticksSinceUnload = 0;
+    size_t usage = memoryUsage();
+    if (usage <= m_memoryBudget) {
+        return;
+    }
+
+    struct Candidate {
+        int64_t zone;
+        unsigned int lastUsed;
+        int distance;
+        size_t bytes;
+    };
+    int playerZoneX = glm::floor(position.x / 64.0f);
+    int playerZoneZ = glm::floor(position.z / 64.0f);
+    std::vector<Candidate> candidates;
+    for (int64_t zone : m_generatedTerrain) {
+        glm::ivec2 corner = toCoords(zone);
+        int distance = glm::max(glm::abs(corner.x / 64 - playerZoneX),
+                                glm::abs(corner.y / 64 - playerZoneZ));
+        // checkExpansion would generate these again right away
+        if (distance <= m_voxelRadius) {
+            continue;
+        }
+        Candidate candidate {zone, 0, distance, 0};
+        for (int x = 0; x < 64; x += 16) {
+            for (int z = 0; z < 64; z += 16) {
+                if (Chunk *c = m_chunks.find(toKey(corner.x + x, corner.y + z))) {
+                    candidate.lastUsed = glm::max(candidate.lastUsed, c->lastUsed());
+                    candidate.bytes += c->memoryUsage();
+                }
+            }
+        }
+        candidates.push_back(candidate);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+        if (a.lastUsed != b.lastUsed) {
+            return a.lastUsed < b.lastUsed;
+        }
+        return a.distance > b.distance;
+    });
+    for (const Candidate &candidate : candidates) {
+        if (usage <= m_memoryBudget) {
+            break;
+        }
+        unloadZone(candidate.zone);
+        usage -= glm::min(usage, candidate.bytes);
+    }
+}
+
+void Terrain::unloadZone(int64_t zone) {
+    m_generatedTerrain.erase(zone);
+    glm::ivec2 corner = toCoords(zone);
+    uint64_t epoch;
+    {
+        // Workers registered from now on can no longer find these Chunks
+        QMutexLocker locker(&m_epochMutex);
+        epoch = m_epoch++;
+    }
+    for (int x = 0; x < 64; x += 16) {
+        for (int z = 0; z < 64; z += 16) {
+            int64_t key = toKey(corner.x + x, corner.y + z);
+            uPtr<Chunk> c = m_chunks.remove(key);
+            if (c == nullptr) {
+                continue;
+            }
+            m_grid.remove(c.get());
+            m_waitingForNeighbors.erase(c.get());
+            m_meshing.erase(c.get());
+            c->retire();
+            if (c->isEdited()) {
+                QMutexLocker locker(&m_savedChunksMutex);
+                m_savedChunks[key] = c->copySections();
+            }
+            m_retiredChunks.emplace_back(epoch, std::move(c));
+        }
+    }
+}
+
+void Terrain::freeRetiredChunks() {
+    if (m_retiredChunks.empty()) {
+        return;
+    }
+    uint64_t oldestWork;
+    {
+        QMutexLocker locker(&m_epochMutex);
+        oldestWork = m_activeWork.empty() ? m_epoch : m_activeWork.begin()->first;
+    }
+    auto unreachable = [oldestWork](const std::pair<uint64_t, uPtr<Chunk>> &retired) {
+        return retired.first < oldestWork;
+    };
+    if (std::none_of(m_retiredChunks.begin(), m_retiredChunks.end(), unreachable)) {
+        return;
+    }
+    std::unordered_set<Chunk*> freed;
+    for (auto &retired : m_retiredChunks) {
+        if (unreachable(retired)) {
+            freed.insert(retired.second.get());
+        }
+    }
+    // The workers that used them are done, but their results may still be
+    // queued. Only this thread takes from the queues, so the rest can be put back.
+    for (Chunk *c : chunksWithOnlyBlockData.takeAll()) {
+        if (freed.count(c) == 0) {
+            chunksWithOnlyBlockData.push(c);
+        }
+    }
+    for (ChunkVBOData &d : chunksWithVBOData.takeAll()) {
+        if (freed.count(d.associated_chunk) == 0) {
+            chunksWithVBOData.push(std::move(d));
+        } else {
+            MeshBufferPool::release(std::move(d.vertex_opq_data));
+            MeshBufferPool::release(std::move(d.vertex_tran_data));
+        }
+    }
+    for (auto &retired : m_retiredChunks) {
+        if (unreachable(retired)) {
+            retired.second->destroy();
+            retired.second.reset();
+        }
+    }
+    m_retiredChunks.erase(std::remove_if(m_retiredChunks.begin(), m_retiredChunks.end(),
+                                         [](const std::pair<uint64_t, uPtr<Chunk>> &retired) {
+                                             return retired.second == nullptr;
+                                         }),
+                          m_retiredChunks.end());
+}
+
+void Terrain::restoreSavedChunks(const std::vector<Chunk*> &chunks) {
+    QMutexLocker locker(&m_savedChunksMutex);
+    if (m_savedChunks.empty()) {
+        return;
+    }
+    for (Chunk *c : chunks) {
+        auto it = m_savedChunks.find(toKey(c->worldPos().x, c->worldPos().y));
+        if (it != m_savedChunks.end()) {
+            c->restoreSections(std::move(it->second));
+            c->markEdited();
+            m_savedChunks.erase(it);
+        }
+    }
+}
+
+std::vector<Chunk*> Terrain::scheduleMeshing(const std::vector<Chunk*> &ready) {
+    static const std::array<Direction, 4> sides {XPOS, XNEG, ZPOS, ZNEG};
+    for (Chunk *c : ready) {
+        // Unloaded while its blocks were being generated
+        if (c->isRetired()) {
+            continue;
+        }
+        m_waitingForNeighbors.insert(c);
+        for (Direction dir : sides) {
+            Chunk *n = c->neighbor(dir);
+            if (n != nullptr && n->meshedWithout(opposite(dir))) {
+                n->markDirty();
+                m_waitingForNeighbors.insert(n);
+            }
+        }
+    }
+
+    std::vector<Chunk*> toMesh;
+    for (auto it = m_waitingForNeighbors.begin(); it != m_waitingForNeighbors.end(); ) {
+        Chunk *c = *it;
+        bool neighborsSettled = std::all_of(sides.begin(), sides.end(), [c](Direction dir) {
+            Chunk *n = c->neighbor(dir);
+            return n == nullptr || n->blocksReady();
+        });
+        if (neighborsSettled && m_meshing.insert(c).second) {
+            toMesh.push_back(c);
+            it = m_waitingForNeighbors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return toMesh;
+}
+
+void Terrain::uploadMeshes() {
+    for (ChunkVBOData &d : chunksWithVBOData.takeAll()) {
+        Chunk *c = d.associated_chunk;
+        if (!c->isRetired()) {
+            m_meshing.erase(c);
+            // A stale mesh was made against an older upload than the one on
+            // the GPU, so its sections could not be spliced in
+            if (c->markUploaded(d.generation)) {
+                c->sendToGPU(&d.vertex_opq_data, &d.vertex_tran_data, d.sections, d.sectionMask);
+            } else {
+                c->markDirty(d.sectionMask);
+            }
+            // Edited while it was meshed
+            if (c->state() == ChunkState::DIRTY) {
+                m_waitingForNeighbors.insert(c);
+            }
+        }
+        MeshBufferPool::release(std::move(d.vertex_opq_data));
+        MeshBufferPool::release(std::move(d.vertex_tran_data));
+    }
+}
+
+void Terrain::remeshAll() {
+    m_chunks.forEach([this](Chunk *c) {
+        if (c->state() >= ChunkState::MESHING) {
+            c->markDirty();
+            chunksWithOnlyBlockData.push(c);
+        }
+    });
+}
+
+long long Terrain::vertexCount(int minX, int maxX, int minZ, int maxZ) const {
+    long long count = 0;
+    for(int x = minX; x < maxX; x += 16) {
+        for(int z = minZ; z < maxZ; z += 16) {
+            if (Chunk *chunk = findChunkAt(x, z)) {
+                // Every quad is 4 vertices and 6 indices
+                count += glm::max(chunk->elemCountOpq(), 0) / 6 * 4;
+                count += glm::max(chunk->elemCountTran(), 0) / 6 * 4;
+            }
+        }
+    }
+    return count;
+}
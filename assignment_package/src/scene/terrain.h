@@ -3,13 +3,19 @@
 #include "src/glm_includes.h"
 #include "chunk.h"
 #include <array>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include "src/shaderprogram.h"
+#include "src/quadindexbuffer.h"
 #include "cube.h"
 #include "river.h"
 #include "QMutex"
 #include "cave.h"
+#include "chunkmap.h"
+#include "chunkgrid.h"
+#include "zoneheightfield.h"
+#include "src/completionqueue.h"
 class River;
 class Cave;
 
@@ -19,14 +25,20 @@ using namespace std;
 // Helper functions to convert (x, z) to and from hash map key
 int64_t toKey(int x, int z);
 glm::ivec2 toCoords(int64_t k);
+// Seed for one kind of random feature (told apart by salt) of the zone whose
+// lower-left corner is (x, z), so a zone generated again comes out the same
+uint32_t zoneSeed(int x, int z, uint32_t salt);
 
 
 struct ChunkVBOData {
-    vector<float> vertex_opq_data;
-    vector<float> vertex_tran_data;
-    vector<GLuint> idx_opq_data;
-    vector<GLuint> idx_tran_data;
+    vector<ChunkVertex> vertex_opq_data;
+    vector<ChunkVertex> vertex_tran_data;
+    SectionOffsets sections;
     Chunk *associated_chunk;
+    // Chunk::beginMeshing's generation, to tell stale meshes apart
+    uint64_t generation;
+    // The sections that were meshed; the others are left as uploaded
+    uint16_t sectionMask;
 };
 
 // The container class for all of the Chunks in the game.
@@ -42,7 +54,12 @@ private:
     // We combine the X and Z coordinates of the Chunk's corner into one 64-bit int
     // so that we can use them as a key for the map, as objects like std::pairs or
     // glm::ivec2s are not hashable by default, so they cannot be used as keys.
-    std::unordered_map<int64_t, uPtr<Chunk>> m_chunks;
+    // Worker threads look Chunks up while the main thread inserts new ones,
+    // which the ChunkMap allows.
+    ChunkMap m_chunks;
+    // The Chunks around the player, indexed directly. Chunks are looked up
+    // here first and in m_chunks only if the grid does not hold them.
+    ChunkGrid m_grid;
 
     // We will designate every 64 x 64 area of the world's x-z plane
     // as one "terrain generation zone". Every time the player moves
@@ -54,10 +71,55 @@ private:
     // one 64 x 64 area with its lower-left corner at (0, 0).
     // When milestone 1 has been implemented, the Player can move around the
     // world to add more "terrain generation zone" IDs to this set.
-    // While only the 3 x 3 collection of terrain generation zones
-    // surrounding the Player should be rendered, the Chunks
-    // in the Terrain will never be deleted until the program is terminated.
+    // Zones far from the Player are unloaded again once the Terrain holds
+    // more than its memory budget (see unloadChunks) and dropped from this
+    // set, so they are generated anew when the Player comes back.
     std::unordered_set<int64_t> m_generatedTerrain;
+    // Zones within this many zones of the player's are voxelized
+    int m_voxelRadius;
+
+    // The heightfields of the zones around the player, including zones
+    // that are not voxelized (main thread only). A zone's heightfield is
+    // made once, by a heightfield job or by the job voxelizing the zone,
+    // and is shared with the jobs voxelizing it later.
+    std::unordered_map<int64_t, sPtr<const ZoneHeightfield>> m_heightfields;
+    // Zones whose heightfield is being made (main thread only)
+    std::unordered_set<int64_t> m_sampling;
+
+    // Bytes of Chunk memory (blocks and VBOs) above which zones are unloaded
+    size_t m_memoryBudget;
+    // Counts calls to draw; Chunks remember the frame they were last drawn in
+    unsigned int m_frame;
+    // Ticks since unloadChunks last measured the memory in use
+    int m_ticksSinceUnload;
+    // Worker threads hold Chunk* without any lock, so an unloaded Chunk is
+    // only deleted once every worker that could have seen it has finished.
+    // Each worker registers the current epoch when it is handed its Chunks;
+    // a Chunk retired in epoch e is freed once no worker of an epoch <= e
+    // is left.
+    QMutex m_epochMutex;
+    uint64_t m_epoch;
+    // Running workers per epoch
+    std::map<uint64_t, int> m_activeWork;
+    // Unloaded Chunks waiting to be freed, with the epoch they were retired in
+    std::vector<std::pair<uint64_t, uPtr<Chunk>>> m_retiredChunks;
+    // Blocks of unloaded Chunks the player edited, by Chunk key. They replace
+    // the generated blocks when the Chunk's zone is generated again.
+    std::unordered_map<int64_t, std::vector<PalettedStorage>> m_savedChunks;
+    mutable QMutex m_savedChunksMutex;
+
+    // Chunks whose blocks are ready, waiting for the blocks of their
+    // neighbors before they are meshed (main thread only)
+    std::unordered_set<Chunk*> m_waitingForNeighbors;
+    // Chunks with a mesh job in flight (main thread only). They are not
+    // meshed again until its result is uploaded, so partial meshes are
+    // always spliced into the mesh they were made against.
+    std::unordered_set<Chunk*> m_meshing;
+
+    // Unloads the zone and erases it from m_generatedTerrain
+    void unloadZone(int64_t zone);
+    // Frees the retired Chunks no worker can reach any more
+    void freeRetiredChunks();
 
     // TODO: DELETE ALL REFERENCES TO m_geomCube AS YOU WILL NOT USE
     // IT IN YOUR FINAL PROGRAM!
@@ -70,6 +132,9 @@ private:
 
     OpenGLContext* mp_context;
 
+    // Indices every Chunk is drawn with
+    QuadIndexBuffer m_quadIndices;
+
     int time;
 
 public:
@@ -77,11 +142,10 @@ public:
     ~Terrain();
 
     // Minseok Kim MS2
-    std::vector<Chunk*> chunksWithOnlyBlockData;
-    QMutex mutexWithOnlyBlockData;
-
-    std::vector<ChunkVBOData> chunksWithVBOData;
-    QMutex mutexChunksWithVBOData;
+    // Workers hand their results to the main thread through these
+    CompletionQueue<Chunk*> chunksWithOnlyBlockData;
+    CompletionQueue<ChunkVBOData> chunksWithVBOData;
+    CompletionQueue<std::pair<int64_t, sPtr<const ZoneHeightfield>>> zonesWithHeightfields;
 
     // Instantiates a new Chunk and stores it in
     // our chunk map at the given coordinates.
@@ -91,11 +155,11 @@ public:
     // a Chunk that exists?
     bool hasChunkAt(int x, int z) const;
     // Assuming a Chunk exists at these coords,
-    // return a mutable reference to it
-    uPtr<Chunk>& getChunkAt(int x, int z);
-    // Assuming a Chunk exists at these coords,
-    // return a const reference to it
-    const uPtr<Chunk>& getChunkAt(int x, int z) const;
+    // return a pointer to it
+    Chunk* getChunkAt(int x, int z) const;
+    // The Chunk containing these world-space coordinates, or nullptr if
+    // there is none. Never throws or inserts into the map.
+    Chunk* findChunkAt(int x, int z) const;
     // Given a world-space coordinate (which may have negative
     // values) return the block stored at that point in space.
     BlockType getBlockAt(int x, int y, int z) const;
@@ -104,6 +168,36 @@ public:
     // values) set the block at that point in space to the
     // given type.
     void setBlockAt(int x, int y, int z, BlockType t);
+    // setBlockAt for a change made by the player: the Chunk is remembered as
+    // edited, so the change outlives unloading, and remeshed around the block
+    void editBlockAt(int x, int y, int z, BlockType t);
+    // Bulk writes in world space. Each Chunk touched is looked up once and
+    // written under a single lock. Blocks outside every loaded Chunk or
+    // outside y in [0, 256) are skipped, and only blocks the filter
+    // accepts are overwritten.
+    // Fills y in [yMin, yMax) of the column at (x, z)
+    void fillColumn(int x, int z, int yMin, int yMax, BlockType t,
+                    const BlockFilter &filter = BlockFilter::any());
+    // Fills the box [lo, hi)
+    void fillBox(glm::ivec3 lo, glm::ivec3 hi, BlockType t,
+                 const BlockFilter &filter = BlockFilter::any());
+    // Fills every block within squared distance radiusSquared of center
+    // whose y is in [yMin, yMax)
+    void fillSphere(glm::ivec3 center, int radiusSquared, BlockType t,
+                    const BlockFilter &filter = BlockFilter::any(),
+                    int yMin = 0, int yMax = 256);
+    // y of the highest non-EMPTY block in the column at these world-space
+    // coordinates, or -1 if the column is empty. Throws like getBlockAt.
+    int getHighestBlockAt(int x, int z) const;
+    // y of the lowest block in the column that does not hide the faces
+    // next to it, or 256 if every block is opaque. Throws like getBlockAt.
+    int getLowestExposedAt(int x, int z) const;
+    // Marks the Chunk sections whose faces a change to the block at these
+    // world-space coordinates can affect dirty: its own section and the
+    // sections across any section or Chunk border it touches. Their Chunks
+    // are queued to be meshed again on a worker; until the new mesh is
+    // uploaded, the old one keeps being drawn.
+    void markDirtyAround(int x, int y, int z);
 
     // Draws every Chunk that falls within the bounding box
     // described by the min and max coords, using the provided
@@ -132,8 +226,108 @@ public:
     float fbm(float);
     float noise1D(int);
     float remap(float, float, float, float, float);
+    // The height functions above, from the noise they read
+    int grasslandHeightOf(float worley);
+    int mountainHeightOf(float perlin);
+    int sandHeightOf(float worley);
+    // The column getColumnSurface makes of the three heights and of the
+    // perlin noise at (x, z) / 256 and (x, z) / 200, which blend them
+    ColumnSurface blendColumn(int mheight, int gheight, int sheight, float t, float t2);
+    // The blend of the three height functions fillBlock generates the
+    // column at (x, z) from. Touches no Chunk, so it also serves the
+    // far terrain no Chunk is generated for.
+    ColumnSurface getColumnSurface(int x, int z);
     void fillBlock(int x, int z);
+    // y one above the generated surface at (x, z), e.g. to spawn on, from
+    // the zone's heightfield if there is one. Ignores rivers, caves and edits.
+    int getSurfaceHeightAt(int x, int z);
+
+    // Default for setVoxelRadius
+    static const int DEFAULT_VOXEL_RADIUS = 4;
+    // The largest radius setVoxelRadius accepts
+    static constexpr int MAX_VOXEL_RADIUS = 7;
+    // Chunks the voxelized zones reach past the player's Chunk in x and z
+    // at MAX_VOXEL_RADIUS: the rest of the player's zone, then 4 a zone
+    static const int MAX_VOXEL_REACH = 4 * MAX_VOXEL_RADIUS + 3;
+    // m_grid holds every voxelized Chunk around the player at any radius
+    static const int CHUNK_GRID_SIZE_LOG2 = ChunkGrid::sizeLog2For(MAX_VOXEL_REACH);
+    static_assert(DEFAULT_VOXEL_RADIUS <= MAX_VOXEL_RADIUS, "The default voxel radius must be allowed");
+    static_assert((1 << CHUNK_GRID_SIZE_LOG2) / 2 >= MAX_VOXEL_REACH + 1,
+                  "The voxelized zones must fit in the ChunkGrid, or their Chunks alias its slots");
+    // Zones around the player's zone in each direction that get a heightfield
+    static const int HEIGHTFIELD_RADIUS = 12;
+    // Blocks drawn around the player's zone in each direction
+    static const int DRAW_DISTANCE = 256;
+    // Chunks per ring of one level of detail: within this many Chunks of
+    // the player's Chunk they are meshed in full detail, within twice as
+    // many at the next level, and so on up to Chunk::MAX_LEVEL_OF_DETAIL
+    static const int LEVEL_OF_DETAIL_RING = 4;
+
+    // Zones around the player's zone in each direction that are voxelized,
+    // at most MAX_VOXEL_RADIUS. The ones past it up to HEIGHTFIELD_RADIUS
+    // only get their heightfield.
+    void setVoxelRadius(int zones);
+    int voxelRadius() const;
 
     // Min MS2
+    // Zones within the voxel radius that have no Chunks yet, which are
+    // marked as generated. Their heightfields, if already made, are
+    // handed to the jobs voxelizing them through heightfieldOf.
     std::vector<int64_t> checkExpansion(glm::vec3 position);
+    // Zones within HEIGHTFIELD_RADIUS whose heightfield is neither made
+    // nor being made by any job, nearest first. They are marked as being
+    // made, and queued to zonesWithHeightfields once done.
+    std::vector<int64_t> checkHeightfieldExpansion(glm::vec3 position);
+    // Called every tick on the main thread. Stores the finished
+    // heightfields and drops the ones a zone past HEIGHTFIELD_RADIUS.
+    void updateHeightfields(glm::vec3 position);
+    // The zone's heightfield, or nullptr if it is not made yet
+    sPtr<const ZoneHeightfield> heightfieldOf(int64_t zone) const;
+    // Moves the window of directly indexed Chunks along with the player
+    void recenter(glm::vec3 position);
+    // Gives every Chunk around the player the level of detail of its ring
+    // and queues the ones already meshed at another level to be meshed
+    // again. A Chunk only becomes coarser once it is a Chunk past its
+    // ring's edge, so walking along the edge does not remesh it every time.
+    void updateLevelsOfDetail(glm::vec3 position);
+
+    // Default for setMemoryBudget
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t(512) << 20;
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+    // Bytes held by all loaded Chunks and by the blocks kept for the
+    // edited ones that were unloaded
+    size_t memoryUsage() const;
+    // Worker threads call beginWork before they are handed any Chunk* and
+    // endWork with its result once they no longer use them
+    uint64_t beginWork();
+    void endWork(uint64_t epoch);
+    // Called every tick on the GL thread. While the Chunks use more memory
+    // than the budget, unloads whole zones outside the generation radius
+    // around the player, least recently drawn first and, among those, the
+    // farthest first. Also frees the Chunks retired earlier that no worker
+    // can reach any more.
+    void unloadChunks(glm::vec3 position);
+    // Gives the Chunks of a newly generated zone back the blocks saved when
+    // they were unloaded after an edit
+    void restoreSavedChunks(const std::vector<Chunk*> &chunks);
+
+    // Takes the Chunks whose blocks just became ready (or that need a new
+    // mesh) and returns the ones to mesh now, on the main thread. A Chunk is
+    // held back until each of its neighbors either has its blocks ready or
+    // does not exist, so in the common case it is meshed once, against its
+    // neighbors' real borders. Neighbors that were meshed without this
+    // Chunk's blocks are scheduled again.
+    // A Chunk whose mesh job is still in flight is held back until its
+    // result is uploaded.
+    std::vector<Chunk*> scheduleMeshing(const std::vector<Chunk*> &ready);
+    // Uploads the finished meshes on the GL thread, dropping stale ones.
+    // Chunks that changed while they were meshed are scheduled again.
+    void uploadMeshes();
+
+    // Queues every Chunk that already has a VBO to be meshed again,
+    // e.g. after switching between the per-face and greedy mesher
+    void remeshAll();
+    // Total vertices uploaded for the Chunks within the given bounds
+    long long vertexCount(int minX, int maxX, int minZ, int maxZ) const;
 };
@@ -0,0 +1,123 @@
+#include "zonegenerator.h"
+#include "terrain.h"
+#include "noisegrid.h"
+#include "river.h"
+#include "cave.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+std::array<std::atomic<long long>, ZoneGenerator::STAGE_COUNT> ZoneGenerator::s_nanoseconds {};
+std::array<std::atomic<long long>, ZoneGenerator::STAGE_COUNT> ZoneGenerator::s_zones {};
+
+ZoneGenerator::ZoneGenerator(Terrain *terrain, int64_t zone)
+    : mp_terrain(terrain), m_corner(toCoords(zone)),
+      m_mountain(), m_worley(), m_biome(), m_sand()
+{}
+
+void ZoneGenerator::generateBiomeFields() {
+    QElapsedTimer timer;
+    timer.start();
+    m_mountain.resize(SIDE * SIDE);
+    m_worley.resize(SIDE * SIDE);
+    m_biome.resize(SIDE * SIDE);
+    m_sand.resize(SIDE * SIDE);
+    NoiseGrid::perlin(m_corner.x, m_corner.y, SIDE, SIDE, 32.f, m_mountain.data());
+    NoiseGrid::perlin(m_corner.x, m_corner.y, SIDE, SIDE, 256.f, m_biome.data());
+    NoiseGrid::perlin(m_corner.x, m_corner.y, SIDE, SIDE, 200.f, m_sand.data());
+    // Worley noise at (x, z) / 64 is the perlin noise at (x, z) / 32,
+    // already in m_mountain, times a distance
+    NoiseGrid::worleyDistance(m_corner.x, m_corner.y, SIDE, SIDE, 64.f, m_worley.data());
+    for (int i = 0; i < SIDE * SIDE; ++i) {
+        m_worley[i] = std::abs(m_mountain[i]) * m_worley[i];
+    }
+    addStageTime(BIOME_FIELDS, timer.nsecsElapsed());
+}
+
+void ZoneGenerator::generateHeightFields(ZoneHeightfield *heightfield) {
+    QElapsedTimer timer;
+    timer.start();
+    for (int z = 0; z < SIDE; ++z) {
+        for (int x = 0; x < SIDE; ++x) {
+            int i = x + SIDE * z;
+            heightfield->set(x, z, mp_terrain->blendColumn(mp_terrain->mountainHeightOf(m_mountain[i]),
+                                                           mp_terrain->grasslandHeightOf(m_worley[i]),
+                                                           mp_terrain->sandHeightOf(m_worley[i]),
+                                                           m_biome[i], m_sand[i]));
+        }
+    }
+    addStageTime(HEIGHT_FIELDS, timer.nsecsElapsed());
+}
+
+void ZoneGenerator::fillColumns(const ZoneHeightfield &heightfield) {
+    QElapsedTimer timer;
+    timer.start();
+    // Stone up to y = 128, the filler above that and the surface block on
+    // top. Each Chunk gets the stone below its lowest column as one box,
+    // which refills its whole sections outright; the rest of every column
+    // is written as three runs.
+    for (int chunkX = 0; chunkX < SIDE; chunkX += 16) {
+        for (int chunkZ = 0; chunkZ < SIDE; chunkZ += 16) {
+            int stoneTop = 129;
+            for (int x = chunkX; x < chunkX + 16; ++x) {
+                for (int z = chunkZ; z < chunkZ + 16; ++z) {
+                    stoneTop = std::min(stoneTop, heightfield.at(x, z).top - 1);
+                }
+            }
+            glm::ivec3 origin(m_corner.x + chunkX, 0, m_corner.y + chunkZ);
+            mp_terrain->fillBox(origin, origin + glm::ivec3(16, stoneTop, 16), STONE);
+            for (int x = chunkX; x < chunkX + 16; ++x) {
+                for (int z = chunkZ; z < chunkZ + 16; ++z) {
+                    ColumnSurface column = heightfield.at(x, z);
+                    int wx = m_corner.x + x;
+                    int wz = m_corner.y + z;
+                    mp_terrain->fillColumn(wx, wz, stoneTop, std::min(129, column.top - 1), STONE);
+                    mp_terrain->fillColumn(wx, wz, 129, column.top - 1, column.filler);
+                    mp_terrain->fillColumn(wx, wz, column.top - 1, column.top, column.surface);
+                }
+            }
+        }
+    }
+    addStageTime(COLUMN_FILL, timer.nsecsElapsed());
+}
+
+void ZoneGenerator::addFeatures() {
+    QElapsedTimer timer;
+    timer.start();
+    River river = River(mp_terrain, m_corner.x, m_corner.y);
+    Cave cave = Cave(mp_terrain, m_corner.x, m_corner.y);
+    // Seeded by the zone, so it gets the same features if it is generated again
+    std::minstd_rand zoneRandom(zoneSeed(m_corner.x, m_corner.y, 0));
+    std::uniform_real_distribution<double> uniform(0, 1);
+    double random = uniform(zoneRandom);
+    if (random < 0.15)
+       river.draw();
+    double random2 = uniform(zoneRandom);
+    if (random2 < 0.15)
+    {
+       cave.carveOpening();
+    }
+    addStageTime(FEATURES, timer.nsecsElapsed());
+}
+
+void ZoneGenerator::addStageTime(Stage stage, long long nanoseconds) {
+    s_nanoseconds[stage].fetch_add(nanoseconds, std::memory_order_relaxed);
+    s_zones[stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::array<double, ZoneGenerator::STAGE_COUNT> ZoneGenerator::averageStageTimes() {
+    std::array<double, STAGE_COUNT> times;
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        long long zones = s_zones[stage].load(std::memory_order_relaxed);
+        times[stage] = zones == 0 ? 0.0 : s_nanoseconds[stage].load(std::memory_order_relaxed) / 1e6 / zones;
+    }
+    return times;
+}
+
+const char* ZoneGenerator::stageName(Stage stage) {
+    static const char* const names[STAGE_COUNT] = {
+        "biome fields", "height fields", "column fill", "features"
+    };
+    return names[stage];
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <vector>
+#include "src/glm_includes.h"
+#include "zoneheightfield.h"
+
+class Terrain;
+
+// Generates one 64 x 64 terrain generation zone in stages. Each stage
+// reads the flat per-column arrays (index x + 64 * z) the stage before it
+// wrote, so every noise field is computed exactly once per column:
+//   BIOME_FIELDS: the noise fields the columns are blended from
+//   HEIGHT_FIELDS: the surface of every column, i.e. the zone's heightfield
+//   COLUMN_FILL: the blocks of every column, from the heightfield
+//   FEATURES: rivers and caves, seeded by the zone
+// The first two only need the zone's coordinates and the last two only
+// its heightfield, so they can run on different workers and at different
+// times: far zones only run the first two (see Terrain::HEIGHTFIELD_RADIUS).
+// Every stage adds its time to counters shared by all threads.
+class ZoneGenerator
+{
+public:
+    enum Stage {
+        BIOME_FIELDS, HEIGHT_FIELDS, COLUMN_FILL, FEATURES, STAGE_COUNT
+    };
+
+    ZoneGenerator(Terrain *terrain, int64_t zone);
+
+    void generateBiomeFields();
+    // Needs generateBiomeFields
+    void generateHeightFields(ZoneHeightfield *heightfield);
+    // The zone's Chunks must exist and be generating
+    void fillColumns(const ZoneHeightfield &heightfield);
+    void addFeatures();
+
+    // Average milliseconds one zone spent in each stage so far
+    static std::array<double, STAGE_COUNT> averageStageTimes();
+    static const char* stageName(Stage stage);
+
+private:
+    static const int SIDE = ZoneHeightfield::SIDE;
+
+    Terrain *mp_terrain;
+    // Lower-left corner of the zone
+    glm::ivec2 m_corner;
+
+    // Perlin noise at (x, z) / 32: the mountains, and the perlin factor of
+    // the worley noise at (x, z) / 64
+    std::vector<float> m_mountain;
+    // Worley noise at (x, z) / 64: the grassland and the sand
+    std::vector<float> m_worley;
+    // Perlin noise at (x, z) / 256, blending grassland and mountains
+    std::vector<float> m_biome;
+    // Perlin noise at (x, z) / 200, blending in the sand
+    std::vector<float> m_sand;
+
+    static std::array<std::atomic<long long>, STAGE_COUNT> s_nanoseconds;
+    static std::array<std::atomic<long long>, STAGE_COUNT> s_zones;
+
+    static void addStageTime(Stage stage, long long nanoseconds);
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "chunk.h"
+
+// The generated column at some (x, z), before rivers and caves: stone up to
+// y = 128, filler above that and one surface block at y = top - 1
+struct ColumnSurface {
+    int top;
+    BlockType filler;
+    BlockType surface;
+};
+
+// The 2D fields of one 64 x 64 terrain generation zone: the surface of every
+// column as Terrain::getColumnSurface generates it, without any block.
+// At 3 bytes a column it is about 1/200 of the zone's Chunks, so zones far
+// from the player keep only this until they are voxelized.
+class ZoneHeightfield
+{
+public:
+    static const int SIDE = 64;
+
+    // (x, z) relative to the zone's lower-left corner
+    ColumnSurface at(int x, int z) const {
+        const Column &c = m_columns[x + SIDE * z];
+        return ColumnSurface {c.surfaceY + 1, c.filler, c.surface};
+    }
+    void set(int x, int z, const ColumnSurface &column) {
+        // Every generated surface lies in [128, 256)
+        m_columns[x + SIDE * z] = Column {uint8_t(column.top - 1), column.filler, column.surface};
+    }
+
+private:
+    struct Column {
+        uint8_t surfaceY;
+        BlockType filler;
+        BlockType surface;
+    };
+
+    std::array<Column, SIDE * SIDE> m_columns;
+};
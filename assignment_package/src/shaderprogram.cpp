@@ -9,9 +9,9 @@
 
 ShaderProgram::ShaderProgram(OpenGLContext *context)
     : vertShader(), fragShader(), prog(),
-      attrPos(-1), attrNor(-1), attrCol(-1), attrUv(-1), animate(-1),
+      attrPos(-1), attrNor(-1), attrCol(-1), attrUv(-1), attrPacked(-1),
       unifModel(-1), unifModelInvTr(-1), unifViewProj(-1), unifColor(-1),
-      unifSampler2D(-1), unifTime(-1), context(context)
+      unifSampler2D(-1), unifTime(-1), unifChunkOrigin(-1), unifVoxelBounds(-1), context(context)
 {}
 
 void ShaderProgram::create(const char *vertfile, const char *fragfile)
@@ -64,8 +64,9 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
 
     attrPos = context->glGetAttribLocation(prog, "vs_Pos");
     attrNor = context->glGetAttribLocation(prog, "vs_Nor");
+    attrCol = context->glGetAttribLocation(prog, "vs_Col");
     attrUv = context->glGetAttribLocation(prog, "vs_UV");
-    animate = context->glGetAttribLocation(prog, "vs_animate");
+    attrPacked = context->glGetAttribLocation(prog, "vs_Packed");
 
     unifModel      = context->glGetUniformLocation(prog, "u_Model");
     unifModelInvTr = context->glGetUniformLocation(prog, "u_ModelInvTr");
@@ -73,6 +74,8 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
     unifColor      = context->glGetUniformLocation(prog, "u_Color");
     unifSampler2D = context->glGetUniformLocation(prog, "u_Texture");
     unifTime = context->glGetUniformLocation(prog, "u_Time");
+    unifChunkOrigin = context->glGetUniformLocation(prog, "u_ChunkOrigin");
+    unifVoxelBounds = context->glGetUniformLocation(prog, "u_VoxelBounds");
     // Sky demo
     unifDimensions = context->glGetUniformLocation(prog, "u_Dimensions");
     unifEye = context->glGetUniformLocation(prog, "u_Eye");
@@ -132,6 +135,26 @@ void ShaderProgram::setViewProjMatrix(const glm::mat4 &vp)
     }
 }
 
+void ShaderProgram::setChunkOrigin(const glm::ivec3 &origin)
+{
+    useMe();
+
+    if(unifChunkOrigin != -1)
+    {
+        context->glUniform3f(unifChunkOrigin, origin.x, origin.y, origin.z);
+    }
+}
+
+void ShaderProgram::setVoxelBounds(int minX, int maxX, int minZ, int maxZ)
+{
+    useMe();
+
+    if(unifVoxelBounds != -1)
+    {
+        context->glUniform4f(unifVoxelBounds, minX, minZ, maxX, maxZ);
+    }
+}
+
 void ShaderProgram::setGeometryColor(glm::vec4 color)
 {
     useMe();
@@ -202,7 +225,7 @@ void ShaderProgram::draw(Drawable &d)
 }
 
 //use this draw function for interleaved vbo data for chunks (Elaine 1st)
-void ShaderProgram::drawInterleaved(Drawable &d, int textureSlot = 0, int version = 0, int t = 0) {
+void ShaderProgram::drawInterleaved(Drawable &d, QuadIndexBuffer &indices, int textureSlot = 0, int version = 0, int t = 0) {
     useMe();
 
     if(d.elemCountOpq() < 0) {
@@ -220,44 +243,28 @@ void ShaderProgram::drawInterleaved(Drawable &d, int textureSlot = 0, int versio
         context->glUniform1i(unifTime, t);
     }
 
+    // Chunk vertices are two packed unsigned ints (see ChunkVertex), so they
+    // go through glVertexAttribIPointer to reach the shader as a uvec2
     if (version == 0) {
-        if (attrPos != -1 && attrUv != -1 && attrNor != -1 && animate != -1 && d.bindAllOpaque()) {
-            context->glEnableVertexAttribArray(attrPos);
-            context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)0);
-            context->glEnableVertexAttribArray(attrNor);
-            context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(4*sizeof(float)));
-            context->glEnableVertexAttribArray(attrUv);
-            context->glVertexAttribPointer(attrUv, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(8*sizeof(float)));
-            context->glEnableVertexAttribArray(animate);
-            context->glVertexAttribPointer(animate, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(10*sizeof(float)));
+        if (attrPacked != -1 && d.bindAllOpaque()) {
+            context->glEnableVertexAttribArray(attrPacked);
+            context->glVertexAttribIPointer(attrPacked, 2, GL_UNSIGNED_INT, 2 * sizeof(GLuint), (void*)0);
         }
-        d.bindIdxOpq();
-        context->glDrawElements(d.drawMode(), d.elemCountOpq(), GL_UNSIGNED_INT, 0);
+        GLenum indexType = indices.bind(d.elemCountOpq() / 6);
+        context->glDrawElements(d.drawMode(), d.elemCountOpq(), indexType, 0);
 
-        if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-        if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
-        if (attrUv != -1) context->glDisableVertexAttribArray(attrUv);
-        if (animate != -1) context->glDisableVertexAttribArray(animate);
+        if (attrPacked != -1) context->glDisableVertexAttribArray(attrPacked);
         context->printGLErrorLog();
 
     } else {
-        if (attrPos != -1 && attrUv != -1 && attrNor != -1 && animate != -1 && d.bindAllTransparent()) {
-            context->glEnableVertexAttribArray(attrPos);
-            context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)0);
-            context->glEnableVertexAttribArray(attrNor);
-            context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(4*sizeof(float)));
-            context->glEnableVertexAttribArray(attrUv);
-            context->glVertexAttribPointer(attrUv, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(8*sizeof(float)));
-            context->glEnableVertexAttribArray(animate);
-            context->glVertexAttribPointer(animate, 4, GL_FLOAT, false, 11 * sizeof(float), (void*)(10*sizeof(float)));
+        if (attrPacked != -1 && d.bindAllTransparent()) {
+            context->glEnableVertexAttribArray(attrPacked);
+            context->glVertexAttribIPointer(attrPacked, 2, GL_UNSIGNED_INT, 2 * sizeof(GLuint), (void*)0);
         }
-        d.bindIdxTran();
-        context->glDrawElements(d.drawMode(), d.elemCountTran(), GL_UNSIGNED_INT, 0);
+        GLenum indexType = indices.bind(d.elemCountTran() / 6);
+        context->glDrawElements(d.drawMode(), d.elemCountTran(), indexType, 0);
 
-        if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-        if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
-        if (attrUv != -1) context->glDisableVertexAttribArray(attrUv);
-        if (animate != -1) context->glDisableVertexAttribArray(animate);
+        if (attrPacked != -1) context->glDisableVertexAttribArray(attrPacked);
         context->printGLErrorLog();
     }
 
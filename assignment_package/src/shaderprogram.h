@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 
 #include "drawable.h"
+#include "quadindexbuffer.h"
 
 
 class ShaderProgram
@@ -20,7 +21,7 @@ public:
     int attrCol; // A handle for the "in" vec4 representing vertex color in the vertex shader
 
     int attrUv; // A handle for the "in" vec4 representing vertex uv in the vertex shader
-    int animate; //for water and lava animation
+    int attrPacked; // A handle for the "in" uvec2 holding a packed ChunkVertex in the vertex shader
 
     int unifModel; // A handle for the "uniform" mat4 representing model matrix in the vertex shader
     int unifModelInvTr; // A handle for the "uniform" mat4 representing inverse transpose of the model matrix in the vertex shader
@@ -29,6 +30,8 @@ public:
 
     int unifSampler2D; // A handle to the uniform sampler2D that will be used to read the texture
     int unifTime; // A handle for the uniform flaot representing time
+    int unifChunkOrigin; // A handle for the "uniform" vec3 that chunk-local vertex positions are relative to
+    int unifVoxelBounds; // A handle for the "uniform" vec4 holding the x-z box the far terrain leaves out
 
     int unifDimensions;
     int unifEye;
@@ -42,12 +45,16 @@ public:
     void setModelMatrix(const glm::mat4 &model);
     // Pass the given Projection * View matrix to this shader on the GPU
     void setViewProjMatrix(const glm::mat4 &vp);
+    // Pass the world position of the chunk about to be drawn to this shader on the GPU
+    void setChunkOrigin(const glm::ivec3 &origin);
+    // Pass the x-z box [minX, maxX) x [minZ, maxZ) the Chunks are drawn in to this shader on the GPU
+    void setVoxelBounds(int minX, int maxX, int minZ, int maxZ);
     // Pass the given color to this shader on the GPU
     void setGeometryColor(glm::vec4 color);
     // Draw the given object to our screen using this ShaderProgram's shaders
     void draw(Drawable &d);
-    //Draw second function with interleaved
-    void drawInterleaved(Drawable &d, int textureSlot, int version, int t);
+    //Draw second function with interleaved, indexed by the shared quad indices
+    void drawInterleaved(Drawable &d, QuadIndexBuffer &indices, int textureSlot, int version, int t);
     // Utility function used in create()
     char* textFileRead(const char*);
     // Utility function that prints any shader compilation errors to the console
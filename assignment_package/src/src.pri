@@ -3,8 +3,11 @@ DEPENDPATH += $$PWD
 
 SOURCES += \
     $$PWD/blocktypeworker.cpp \
+    $$PWD/heightfieldworker.cpp \
+    $$PWD/horizonworker.cpp \
     $$PWD/main.cpp \
     $$PWD/mainwindow.cpp \
+    $$PWD/meshbufferpool.cpp \
     $$PWD/mygl.cpp \
     $$PWD/scene/quad.cpp \
     $$PWD/scene/cave.cpp \
@@ -22,14 +25,25 @@ SOURCES += \
     $$PWD/scene/player.cpp \
     $$PWD/scene/camera.cpp \
     $$PWD/playerinfo.cpp \
+    $$PWD/quadindexbuffer.cpp \
     $$PWD/scene/chunk.cpp \
+    $$PWD/scene/chunkgrid.cpp \
+    $$PWD/scene/chunkmap.cpp \
+    $$PWD/scene/horizon.cpp \
+    $$PWD/scene/noisegrid.cpp \
+    $$PWD/scene/palettedstorage.cpp \
+    $$PWD/scene/zonegenerator.cpp \
     $$PWD/texture.cpp \
     $$PWD/vboworker.cpp \
     $$PWD/worker.cpp
 
 HEADERS += \
     $$PWD/blocktypeworker.h \
+    $$PWD/heightfieldworker.h \
+    $$PWD/horizonworker.h \
     $$PWD/mainwindow.h \
+    $$PWD/meshbufferpool.h \
+    $$PWD/completionqueue.h \
     $$PWD/mygl.h \
     $$PWD/scene/quad.h \
     $$PWD/scene/cave.h \
@@ -39,6 +53,7 @@ HEADERS += \
     $$PWD/shaderprogram.h \
     $$PWD/drawable.h \
     $$PWD/cameracontrolshelp.h \
+    $$PWD/scene/blockregistry.h \
     $$PWD/scene/cube.h \
     $$PWD/openglcontext.h \
     $$PWD/scene/terrain.h \
@@ -49,7 +64,17 @@ HEADERS += \
     $$PWD/scene/player.h \
     $$PWD/scene/camera.h \
     $$PWD/playerinfo.h \
+    $$PWD/quadindexbuffer.h \
     $$PWD/scene/chunk.h \
+    $$PWD/scene/blockcursor.h \
+    $$PWD/scene/chunkgrid.h \
+    $$PWD/scene/chunkmap.h \
+    $$PWD/scene/columnmask.h \
+    $$PWD/scene/horizon.h \
+    $$PWD/scene/noisegrid.h \
+    $$PWD/scene/palettedstorage.h \
+    $$PWD/scene/zonegenerator.h \
+    $$PWD/scene/zoneheightfield.h \
     $$PWD/texture.h \
     $$PWD/vboworker.h \
     $$PWD/worker.h
@@ -1,74 +1,36 @@
 #include "vboworker.h"
 #include "iostream"
+#include "meshbufferpool.h"
 VBOWorker::VBOWorker(Terrain *terrain,
-                    std::vector<ChunkVBOData>* mp_chunksWithVBOData,
-                     Chunk *c,
-                     QMutex *mutex)
+                    CompletionQueue<ChunkVBOData>* mp_chunksWithVBOData,
+                     Chunk *c)
     :mp_terrain(terrain),
       mp_chunksWithVBOData(mp_chunksWithVBOData ),
-      mp_mutex(mutex),
-      mp_chunk(c)
+      mp_chunk(c),
+      m_epoch(terrain->beginWork()),
+      m_generation(c->beginMeshing()),
+      m_sections(c->takeSectionsToMesh()),
+      m_levelOfDetail(c->levelOfDetail())
 {
 }
 void VBOWorker::run() {
-    std::vector<glm::vec4> posOpq;
-    std::vector<glm::vec4> norOpq;
-    std::vector<glm::vec2> uvOpq;
-    std::vector<glm::vec4> posTran;
-    std::vector<glm::vec4> norTran;
-    std::vector<glm::vec2> uvTran;
-    std::vector<float> animOpq;
-    std::vector<float> animTran;
-    std::vector<float> allOpq; //interleaved
-    std::vector<float> allTran;
-    std::vector<GLuint> idxOpq;
-    std::vector<GLuint> idxTran;
-    mp_chunk->createVBO(&posOpq,
-                        &norOpq,
-                        &uvOpq,
-                        &animOpq,
-                        &idxOpq,
-                        &posTran,
-                        &norTran,
-                        &uvTran,
-                        &animTran,
-                        &idxTran);
-
     ChunkVBOData vboData;
     vboData.associated_chunk = mp_chunk;
-    vboData.idx_opq_data = idxOpq;
-    vboData.idx_tran_data = idxTran;
-
-    // interleave opq
-    for (unsigned int i = 0; i < posOpq.size(); ++i) {
-        vboData.vertex_opq_data.push_back(posOpq.at(i)[0]);
-        vboData.vertex_opq_data.push_back(posOpq.at(i)[1]);
-        vboData.vertex_opq_data.push_back(posOpq.at(i)[2]);
-        vboData.vertex_opq_data.push_back(posOpq.at(i)[3]);
-        vboData.vertex_opq_data.push_back(norOpq.at(i)[0]);
-        vboData.vertex_opq_data.push_back(norOpq.at(i)[1]);
-        vboData.vertex_opq_data.push_back(norOpq.at(i)[2]);
-        vboData.vertex_opq_data.push_back(norOpq.at(i)[3]);
-        vboData.vertex_opq_data.push_back(uvOpq.at(i)[0]);
-        vboData.vertex_opq_data.push_back(uvOpq.at(i)[1]);
-        vboData.vertex_opq_data.push_back(animOpq.at(i));
-    }
-
-    for (unsigned int i = 0; i < posTran.size(); ++i) {
-        vboData.vertex_tran_data.push_back(posTran.at(i)[0]);
-        vboData.vertex_tran_data.push_back(posTran.at(i)[1]);
-        vboData.vertex_tran_data.push_back(posTran.at(i)[2]);
-        vboData.vertex_tran_data.push_back(posTran.at(i)[3]);
-        vboData.vertex_tran_data.push_back(norTran.at(i)[0]);
-        vboData.vertex_tran_data.push_back(norTran.at(i)[1]);
-        vboData.vertex_tran_data.push_back(norTran.at(i)[2]);
-        vboData.vertex_tran_data.push_back(norTran.at(i)[3]);
-        vboData.vertex_tran_data.push_back(uvTran.at(i)[0]);
-        vboData.vertex_tran_data.push_back(uvTran.at(i)[1]);
-        vboData.vertex_tran_data.push_back(animTran.at(i));
-    }
+    vboData.generation = m_generation;
+    vboData.sectionMask = m_sections;
+    // Recycled buffers usually have room for a whole mesh already,
+    // so createVBO writes each vertex once without reallocating
+    vboData.vertex_opq_data = MeshBufferPool::acquire(16384);
+    vboData.vertex_tran_data = MeshBufferPool::acquire(1024);
+    mp_chunk->createVBO(&vboData.vertex_opq_data,
+                        &vboData.vertex_tran_data,
+                        &vboData.sections,
+                        m_sections,
+                        m_levelOfDetail);
 
-    mp_mutex->lock();
-    mp_chunksWithVBOData->push_back(vboData);
-    mp_mutex->unlock();
+    // Pushed even if the Chunk changed meanwhile: the mesh is still newer
+    // than the one on the GPU, and the main thread meshes it again after
+    mp_chunk->finishMeshing(m_generation);
+    mp_chunksWithVBOData->push(std::move(vboData));
+    mp_terrain->endWork(m_epoch);
 }
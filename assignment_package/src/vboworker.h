@@ -1,6 +1,5 @@
 #pragma once
 #include <QRunnable>
-#include <QMutex>
 #include <scene/chunk.h>
 #include <scene/terrain.h>
 using namespace std;
@@ -9,16 +8,21 @@ class VBOWorker : public QRunnable
 {
 private:
     Terrain *mp_terrain;
-    std::vector<ChunkVBOData>* mp_chunksWithVBOData;
-    QMutex *mp_mutex;
+    CompletionQueue<ChunkVBOData>* mp_chunksWithVBOData;
     Chunk *mp_chunk;
+    // Terrain::beginWork's epoch, released when run() is done
+    uint64_t m_epoch;
+    // The Chunk's generation when the mesh was requested
+    uint64_t m_generation;
+    // The sections to mesh, see Chunk::takeSectionsToMesh
+    uint16_t m_sections;
+    // The Chunk's level of detail when the mesh was requested
+    int m_levelOfDetail;
 
 public:
 
     VBOWorker(Terrain *terrain,
-              std::vector<ChunkVBOData>* mp_chunksWithVBOData,
-              Chunk *c,
-              QMutex *mutex);
+              CompletionQueue<ChunkVBOData>* mp_chunksWithVBOData,
+              Chunk *c);
     void run() override;
 };
-
@@ -0,0 +1,43 @@
+QT += core widgets
+QT += multimedia
+QT += testlib
+TARGET = tests
+TEMPLATE = app
+# `make check` runs the tests and fails if any of them does
+CONFIG += console testcase
+CONFIG += c++1z
+CONFIG += warn_on
+CONFIG += debug
+
+INCLUDEPATH += $$PWD/.. $$PWD/../include
+
+# The game's sources without its main()
+include(../src/src.pri)
+SOURCES -= $$clean_path($$PWD/../src/main.cpp)
+
+FORMS += ../forms/mainwindow.ui \
+    ../forms/cameracontrolshelp.ui \
+    ../forms/playerinfo.ui
+
+SOURCES += tst_terrain.cpp
+
+*-clang*|*-g++* {
+    CONFIG -= warn_on
+    QMAKE_CXXFLAGS += -Wall -Wextra -pedantic -Winit-self
+    QMAKE_CXXFLAGS += -Wno-strict-aliasing
+    QMAKE_CXXFLAGS += -fno-omit-frame-pointer
+}
+
+address_sanitizer {
+    message("Enabling Address Sanitizer")
+    QMAKE_CXXFLAGS += -fsanitize=address
+    QMAKE_LFLAGS += -fsanitize=address
+}
+
+# `qmake CONFIG+=thread_sanitizer` has the stress tests' accesses checked
+# for data races as well
+thread_sanitizer {
+    message("Enabling Thread Sanitizer")
+    QMAKE_CXXFLAGS += -fsanitize=thread
+    QMAKE_LFLAGS += -fsanitize=thread
+}
@@ -0,0 +1,179 @@
+#include <QtTest>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "src/scene/chunkmap.h"
+#include "src/scene/horizon.h"
+#include "src/scene/noisegrid.h"
+#include "src/scene/terrain.h"
+#include "src/scene/zonegenerator.h"
+
+// None of these touch GL, so the Chunks and Terrains get no context
+class TestTerrain : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    // Two threads insert the same 32 x 32 Chunks while four others look
+    // them up and write blocks to them. No Chunk may go missing, be stored
+    // twice or miss a link to a neighbor.
+    void chunkMapConcurrentAccess();
+    // Every NoiseGrid kernel must give exactly Terrain::perlinNoise and
+    // Terrain::worleyNoise, over odd sizes and negative corners, so the
+    // kernels' scalar tails and the lattice below zero are covered too
+    void noiseGridKernels_data();
+    void noiseGridKernels();
+    // The heightfields ZoneGenerator builds from NoiseGrid must hold the
+    // very columns Terrain::getColumnSurface makes one at a time
+    void zoneHeightfields();
+    // Horizon tiles of every level must put their vertices on the columns
+    // Terrain::getColumnSurface makes
+    void horizonTiles();
+};
+
+void TestTerrain::chunkMapConcurrentAccess() {
+    const int SIDE = 32;
+    ChunkMap map;
+    std::atomic_bool inserting(true);
+    std::atomic<int> missing(0);
+
+    // Both inserters walk the grid in the same order, so they race for
+    // every key and insert side by side Chunks at the same time
+    auto insertAll = [&]() {
+        for (int i = 0; i < SIDE * SIDE; ++i) {
+            int x = 16 * (i % SIDE);
+            int z = 16 * (i / SIDE);
+            uPtr<Chunk> chunk = mkU<Chunk>(nullptr);
+            chunk->setWorldPos(x, z);
+            Chunk *stored = map.insert(x, z, std::move(chunk));
+            if (map.find(toKey(x, z)) != stored) {
+                ++missing;
+            }
+        }
+    };
+    auto lookUp = [&](unsigned int seed) {
+        while (inserting) {
+            seed = seed * 1664525u + 1013904223u;
+            int i = (seed >> 8) % (SIDE * SIDE);
+            if (Chunk *c = map.find(toKey(16 * (i % SIDE), 16 * (i / SIDE)))) {
+                int y = (seed >> 24) & 255;
+                c->setBlockAt(i & 15, y, (i >> 4) & 15, STONE);
+                c->getBlockAt(15 - (i & 15), y, 15 - ((i >> 4) & 15));
+            }
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for (unsigned int seed = 1; seed <= 4; ++seed) {
+        readers.emplace_back(lookUp, seed);
+    }
+    std::thread first(insertAll);
+    std::thread second(insertAll);
+    first.join();
+    second.join();
+    inserting = false;
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    int stored = 0;
+    map.forEach([&](Chunk *) { ++stored; });
+    int unlinked = 0;
+    for (int i = 0; i < SIDE * SIDE; ++i) {
+        int x = 16 * (i % SIDE);
+        int z = 16 * (i / SIDE);
+        Chunk *c = map.find(toKey(x, z));
+        if (c == nullptr) {
+            ++missing;
+            continue;
+        }
+        if (c->neighbor(XPOS) != map.find(toKey(x + 16, z))
+                || c->neighbor(XNEG) != map.find(toKey(x - 16, z))
+                || c->neighbor(ZPOS) != map.find(toKey(x, z + 16))
+                || c->neighbor(ZNEG) != map.find(toKey(x, z - 16))) {
+            ++unlinked;
+        }
+    }
+    QCOMPARE(missing.load(), 0);
+    QCOMPARE(stored, SIDE * SIDE);
+    QCOMPARE(unlinked, 0);
+}
+
+void TestTerrain::noiseGridKernels_data() {
+    QTest::addColumn<int>("kernel");
+    QTest::newRow("scalar") << int(NoiseGrid::SCALAR);
+    QTest::newRow("sse2") << int(NoiseGrid::SSE2);
+    QTest::newRow("avx") << int(NoiseGrid::AVX);
+}
+
+void TestTerrain::noiseGridKernels() {
+    QFETCH(int, kernel);
+    if (!NoiseGrid::supports(NoiseGrid::Kernel(kernel))) {
+        QSKIP("Not supported by this CPU");
+    }
+    Terrain terrain(nullptr);
+    const int x0 = -75, z0 = -37, width = 43, height = 29;
+    std::vector<float> grid(width * height);
+    int perlinMismatches = 0;
+    for (float scale : {32.f, 200.f, 256.f}) {
+        NoiseGrid::perlin(x0, z0, width, height, scale, grid.data(), NoiseGrid::Kernel(kernel));
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                float expected = terrain.perlinNoise(glm::vec2((x0 + i) / scale, (z0 + j) / scale));
+                perlinMismatches += grid[i + width * j] != expected;
+            }
+        }
+    }
+    int worleyMismatches = 0;
+    NoiseGrid::worley(x0, z0, width, height, 64.f, grid.data(), NoiseGrid::Kernel(kernel));
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            float expected = terrain.worleyNoise(glm::vec2((x0 + i) / 64.f, (z0 + j) / 64.f));
+            worleyMismatches += grid[i + width * j] != expected;
+        }
+    }
+    QCOMPARE(perlinMismatches, 0);
+    QCOMPARE(worleyMismatches, 0);
+}
+
+void TestTerrain::zoneHeightfields() {
+    Terrain terrain(nullptr);
+    int topMismatches = 0;
+    int blockMismatches = 0;
+    for (int zoneX = -640; zoneX <= 640; zoneX += 320) {
+        for (int zoneZ = -640; zoneZ <= 640; zoneZ += 320) {
+            ZoneHeightfield heightfield;
+            ZoneGenerator generator(&terrain, toKey(zoneX, zoneZ));
+            generator.generateBiomeFields();
+            generator.generateHeightFields(&heightfield);
+            for (int z = 0; z < 64; ++z) {
+                for (int x = 0; x < 64; ++x) {
+                    ColumnSurface zone = heightfield.at(x, z);
+                    ColumnSurface single = terrain.getColumnSurface(zoneX + x, zoneZ + z);
+                    topMismatches += zone.top != single.top;
+                    blockMismatches += zone.surface != single.surface || zone.filler != single.filler;
+                }
+            }
+        }
+    }
+    QCOMPARE(topMismatches, 0);
+    QCOMPARE(blockMismatches, 0);
+}
+
+void TestTerrain::horizonTiles() {
+    Terrain terrain(nullptr);
+    for (int level = 0; level <= Horizon::MAX_LEVEL; ++level) {
+        HorizonTileData tile = Horizon::sampleTile(&terrain, toKey(-1024, 512), level);
+        int n = Horizon::TILE_SIZE / (Horizon::BASE_STEP << level);
+        int mismatches = 0;
+        // The first (n + 1)^2 vertices are the heightfield, the rest skirts
+        for (int i = 0; i < (n + 1) * (n + 1); ++i) {
+            const glm::vec4 &p = tile.pos[i];
+            mismatches += p.y != float(terrain.getColumnSurface(int(p.x), int(p.z)).top);
+        }
+        QCOMPARE(mismatches, 0);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestTerrain)
+#include "tst_terrain.moc"